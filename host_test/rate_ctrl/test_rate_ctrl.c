@@ -0,0 +1,181 @@
+/*
+ * rate_ctrl against a simulated link: each rate of the ladder delivers a frame with a fixed probability,
+ * unicast frames are acked if delivered. The PRNG is seeded, so the runs are the same every time.
+ */
+
+#include <stdio.h>
+#include "rate_ctrl.h"
+
+static const uint8_t broadcast_addr[RATE_CTRL_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+static const uint8_t mac_a[RATE_CTRL_ADDR_LEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+static const uint8_t mac_b[RATE_CTRL_ADDR_LEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x02};
+
+static int fail_num = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            fail_num ++; \
+        } \
+    } while (0)
+
+// delivery probability of each rate in percent.
+typedef struct link_model_t {
+    uint8_t delivery_list[RATE_CTRL_RATE_NUM];
+} link_model_t;
+
+static uint32_t rand_state = 1;
+
+// xorshift32, in [0, 100).
+static uint32_t rand_percent (void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state % 100;
+}
+
+// send a unicast frame at the rate the link has, return the rate.
+static uint8_t send_unicast (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN], const link_model_t* model_ptr) {
+    uint8_t rate_idx = rate_ctrl_get_rate(ctrl_ptr, mac_addr);
+    rate_ctrl_on_tx(ctrl_ptr, mac_addr, rand_percent() < model_ptr->delivery_list[rate_idx]);
+    return rate_idx;
+}
+
+static rate_link_t* get_link (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN]) {
+    for (int l = 0; l < ctrl_ptr->link_num; l++) {
+        if (memcmp(ctrl_ptr->link_list[l].mac_addr, mac_addr, RATE_CTRL_ADDR_LEN) == 0) return &ctrl_ptr->link_list[l];
+    }
+    return NULL;
+}
+
+// the link settles on the fastest rate that delivers, faster ones are only probed.
+static void test_converge (void) {
+    rate_ctrl_t ctrl;
+    link_model_t model = {{100, 100, 100, 99, 40, 5}};
+    uint32_t rate_num_list[RATE_CTRL_RATE_NUM] = {0};
+    rate_ctrl_init(&ctrl);
+    rate_ctrl_on_msg(&ctrl, mac_a, 0);
+    for (int f = 0; f < 2000; f++) send_unicast(&ctrl, mac_a, &model);
+    for (int f = 0; f < 10000; f++) rate_num_list[send_unicast(&ctrl, mac_a, &model)] ++;
+    printf("converge: frames at each rate %u %u %u %u %u %u\n", rate_num_list[0], rate_num_list[1], rate_num_list[2],
+           rate_num_list[3], rate_num_list[4], rate_num_list[5]);
+    CHECK(rate_num_list[3] >= 9000);
+    CHECK(rate_num_list[5] == 0);
+}
+
+// a probe that fails at once doubles the samples before the next one.
+static void test_aarf_backoff (void) {
+    rate_ctrl_t ctrl;
+    link_model_t model = {{100, 100, 100, 100, 0, 0}};
+    rate_ctrl_init(&ctrl);
+    rate_ctrl_on_msg(&ctrl, mac_a, 0);
+    rate_link_t* link_ptr = get_link(&ctrl, mac_a);
+    // down from the initial rate to #3.
+    while (link_ptr->rate_idx > 3) send_unicast(&ctrl, mac_a, &model);
+    CHECK(link_ptr->up_sample_num == RATE_CTRL_UP_SAMPLES);
+
+    uint16_t up_sample_num = RATE_CTRL_UP_SAMPLES;
+    for (int p = 0; p < 5; p++) {
+        // the good samples before the probe.
+        uint32_t sample_num = 0;
+        while (link_ptr->rate_idx == 3) {
+            send_unicast(&ctrl, mac_a, &model);
+            sample_num ++;
+        }
+        CHECK(link_ptr->rate_idx == 4);
+        CHECK(sample_num == up_sample_num);
+        // the probe fails.
+        while (link_ptr->rate_idx == 4) send_unicast(&ctrl, mac_a, &model);
+        CHECK(link_ptr->rate_idx == 3);
+        up_sample_num *= 2;
+        if (up_sample_num > RATE_CTRL_MAX_UP_SAMPLES) up_sample_num = RATE_CTRL_MAX_UP_SAMPLES;
+        CHECK(link_ptr->up_sample_num == up_sample_num);
+    }
+    printf("aarf backoff: samples before the next probe %u\n", link_ptr->up_sample_num);
+}
+
+// broadcast frames go at the rate of the slowest link.
+static void test_broadcast_slowest (void) {
+    rate_ctrl_t ctrl;
+    link_model_t model_a = {{100, 100, 100, 100, 100, 100}};
+    link_model_t model_b = {{100, 100, 60, 10, 0, 0}};
+    rate_ctrl_init(&ctrl);
+    CHECK(rate_ctrl_get_rate(&ctrl, broadcast_addr) == RATE_CTRL_INIT_RATE);
+    rate_ctrl_on_msg(&ctrl, mac_a, 0);
+    rate_ctrl_on_msg(&ctrl, mac_b, 0);
+    for (int f = 0; f < 2000; f++) {
+        send_unicast(&ctrl, mac_a, &model_a);
+        send_unicast(&ctrl, mac_b, &model_b);
+    }
+    printf("broadcast: rate a #%d, rate b #%d, broadcast #%d\n", rate_ctrl_get_rate(&ctrl, mac_a),
+           rate_ctrl_get_rate(&ctrl, mac_b), rate_ctrl_get_rate(&ctrl, broadcast_addr));
+    CHECK(rate_ctrl_get_rate(&ctrl, mac_a) == RATE_CTRL_RATE_NUM - 1);
+    CHECK(rate_ctrl_get_rate(&ctrl, mac_b) <= 2);
+    CHECK(rate_ctrl_get_rate(&ctrl, broadcast_addr) == rate_ctrl_get_rate(&ctrl, mac_b));
+}
+
+static uint8_t is_mac_a (const uint8_t mac_addr[RATE_CTRL_ADDR_LEN]) {
+    return memcmp(mac_addr, mac_a, RATE_CTRL_ADDR_LEN) == 0;
+}
+
+static void test_prune (void) {
+    rate_ctrl_t ctrl;
+    link_model_t model_b = {{100, 0, 0, 0, 0, 0}};
+    rate_ctrl_init(&ctrl);
+    rate_ctrl_on_msg(&ctrl, mac_a, 0);
+    rate_ctrl_on_msg(&ctrl, mac_b, 0);
+    for (int f = 0; f < 200; f++) send_unicast(&ctrl, mac_b, &model_b);
+    CHECK(rate_ctrl_get_rate(&ctrl, broadcast_addr) == 0);
+    rate_ctrl_prune(&ctrl, is_mac_a);
+    CHECK(ctrl.link_num == 1);
+    CHECK(rate_ctrl_get_rate(&ctrl, broadcast_addr) == RATE_CTRL_INIT_RATE);
+}
+
+// the msgs of the neighbor are sent at its rate: losing them steps the rate down, hearing them all never steps it up.
+static void test_heard_msgs (void) {
+    rate_ctrl_t ctrl;
+    link_model_t model = {{100, 0, 0, 0, 0, 0}};
+    uint16_t seq_num = 0;
+    rate_ctrl_init(&ctrl);
+    rate_ctrl_on_msg(&ctrl, mac_a, seq_num);
+    // half of the msgs are lost.
+    for (int m = 0; m < 200; m++) {
+        seq_num += 2;
+        rate_ctrl_on_msg(&ctrl, mac_a, seq_num);
+    }
+    printf("heard msgs: rate #%d after losing half of them\n", rate_ctrl_get_rate(&ctrl, mac_a));
+    CHECK(rate_ctrl_get_rate(&ctrl, mac_a) < RATE_CTRL_INIT_RATE);
+    // no step up while they are still lost, even if the unicast frames are acked.
+    model.delivery_list[rate_ctrl_get_rate(&ctrl, mac_a)] = 100;
+    model.delivery_list[rate_ctrl_get_rate(&ctrl, mac_a) + 1] = 100;
+    uint8_t rate_idx = rate_ctrl_get_rate(&ctrl, mac_a);
+    for (int f = 0; f < 200; f++) send_unicast(&ctrl, mac_a, &model);
+    CHECK(rate_ctrl_get_rate(&ctrl, mac_a) <= rate_idx);
+
+    // down to #0 by unicast, then all the msgs are heard.
+    rate_ctrl_init(&ctrl);
+    rate_ctrl_on_msg(&ctrl, mac_a, 0);
+    model = (link_model_t){{100, 0, 0, 0, 0, 0}};
+    while (rate_ctrl_get_rate(&ctrl, mac_a) > 0) send_unicast(&ctrl, mac_a, &model);
+    for (int m = 1; m < 1000; m++) rate_ctrl_on_msg(&ctrl, mac_a, m);
+    CHECK(rate_ctrl_get_rate(&ctrl, mac_a) == 0);
+    CHECK(ctrl.up_num == 0);
+    // old and repeated seq nums are not counted.
+    uint32_t down_num = ctrl.down_num;
+    for (int m = 0; m < 100; m++) rate_ctrl_on_msg(&ctrl, mac_a, 500);
+    CHECK(ctrl.down_num == down_num);
+}
+
+int main (void) {
+    test_converge();
+    test_aarf_backoff();
+    test_broadcast_slowest();
+    test_prune();
+    test_heard_msgs();
+    if (fail_num > 0) {
+        printf("%d checks failed\n", fail_num);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
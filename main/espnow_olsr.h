@@ -23,52 +23,64 @@
 #define ESPNOW_WIFI_IF   ESP_IF_WIFI_AP
 #endif
 
-#define ESPNOW_QUEUE_SIZE           16
+#define ESPNOW_TIMER_QUEUE_SIZE     8   // timer slots waiting for the event loop
+#define ESPNOW_RX_BATCH_NUM         32  // max frames handled as one batch (the whole rx ring) before the timer slots are served again
 
 #define ESPNOW_MAX_DATA_LEN        (250)
 #define ESPNOW_MAX_PAYLOAD_LEN     (ESPNOW_MAX_DATA_LEN - sizeof(espnow_olsr_frame_t)) // the length of payload part in one ESPNOW frame.
 #define ESPNOW_MAX_PKT_LEN         (ESPNOW_MAX_PAYLOAD_LEN * 16) // max supported len of a packet.
-
-// the period of timer (ms)
-#define xTIMER_PERIOD               (1000 / portTICK_PERIOD_MS) // 1000 ms
+#define ESPNOW_SEG_NUM(pkt_len)    (((pkt_len) + ESPNOW_MAX_PAYLOAD_LEN - 1) / ESPNOW_MAX_PAYLOAD_LEN) // num of frames of a packet.
+
+// the handlers cut packets at msg boundaries and split HELLO and TC msgs at addr boundaries, so that each packet
+// fits one frame and is parsed on its own, a lost frame only loses the links in it.
+// 0 to send packets of up to 16 frames, which are reassembled by the receivers.
+// trade-off: with 1, this node never sends a packet of more frames, so it sends no parity frames either
+// (ESPNOW_FEC_ENABLE has no effect), and the reassembly and FEC rebuild only run for the packets of
+// nodes built with 0. they stay compiled in so that a mesh of both builds works.
+#define ESPNOW_PKT_PER_FRAME        1
+#define ESPNOW_MAX_TX_PKT_LEN       (ESPNOW_PKT_PER_FRAME ? ESPNOW_MAX_PAYLOAD_LEN : ESPNOW_MAX_PKT_LEN) // max len of the packets from handlers
+#define ESPNOW_EVT_MAX_PKT_NUM      (2 * MSG_MAX_PART_NUM) // a HELLO and a TC msg in parts, forwarded msgs fill them up
+
+// a packet of forwarded msgs only is unicast to each symmetric neighbor which needs them, if there are at most
+// ESPNOW_UNICAST_MAX_DEST_NUM of them, so that its frames are acked and retried by the MAC layer.
+// broadcast is cheaper for more receivers. 0 to always broadcast.
+#define ESPNOW_UNICAST_FWD          1
+#define ESPNOW_UNICAST_MAX_DEST_NUM 2
+
+// parity frames are sent after the frames of a packet, so that receivers can rebuild a lost frame.
+// frame #i of a packet is in parity group i % ESPNOW_FEC_GROUP_NUM, one lost frame per group can be rebuilt.
+// receivers without FEC ignore parity frames.
+// only packets of 2 frames or more have parity frames, so none are sent with ESPNOW_PKT_PER_FRAME 1.
+#define ESPNOW_FEC_ENABLE           1   // 0 to send no parity frames
+#define ESPNOW_FEC_GROUP_NUM        2
+#define ESPNOW_PARITY_NUM(seg_num)  ((ESPNOW_FEC_ENABLE && (seg_num) >= 2) ? ESPNOW_FEC_GROUP_NUM : 0) // num of parity frames of a packet.
+
+#define ESPNOW_TX_POWER             8   // max tx power, in 0.25 dBm
+
+// the period of timer (ms), one slot. the info base time advances every TIMER_SLOTS_PER_TICK slots.
+#define xTIMER_PERIOD               (1000 / TIMER_SLOTS_PER_TICK / portTICK_PERIOD_MS) // 100 ms
 
 typedef enum {
-    ESPNOW_OLSR_SEND_CB,
-    ESPNOW_OLSR_RECV_CB,
     ESPNOW_OLSR_SEND_TO,   // to send a packet
-    ESPNOW_OLSR_TIMER_CB,
     ESPNOW_OLSR_NO_OP,     // to indicate no op is needed.
     ESPNOW_OLSR_UNDEFINE,
 } espnow_olsr_event_id_t;
 
+// pkt.pkt_data is a framed buffer: every ESPNOW_MAX_DATA_LEN bytes hold one frame,
+// a free espnow_olsr_frame_t header followed by the next ESPNOW_MAX_PAYLOAD_LEN bytes of the packet.
+// room for ESPNOW_PARITY_NUM parity frames follows the frames of the packet.
+// pkt.pkt_len is the len of the packet, frame headers not counted. packets are sent in the order of the list.
+// pkt.mac_addr is the dest addr, the broadcast addr or a neighbor's.
 typedef struct {
-    uint8_t mac_addr[RFC5444_ADDR_LEN];
-    esp_now_send_status_t status;
-} espnow_olsr_event_send_cb_t;
-
-typedef struct {
-    uint8_t mac_addr[RFC5444_ADDR_LEN];
-    uint8_t *data;
-    int data_len;
-} espnow_olsr_event_recv_cb_t;
-
-typedef struct {
-    // uint8_t dest_addr[RFC5444_ADDR_LEN]; // we always broadcast
-    raw_pkt_t pkt;
+    uint8_t pkt_num;
+    raw_pkt_t pkt_list[ESPNOW_EVT_MAX_PKT_NUM];
 } espnow_olsr_event_send_to_t;
 
-typedef struct {
-    uint32_t timer_tick;
-} espnow_olsr_event_timer_cb_t;
-
 typedef union {
-    espnow_olsr_event_send_cb_t send_cb;
-    espnow_olsr_event_recv_cb_t recv_cb;
     espnow_olsr_event_send_to_t send_to;
-    espnow_olsr_event_timer_cb_t timer_cb;
 } espnow_olsr_event_info_t;
 
-/* When ESPNOW sending or receiving callback function is called, post event to ESPNOW task. */
+/* The output of the OLSR handlers, passed straight to the TX stage of the event loop. */
 typedef struct {
     espnow_olsr_event_id_t id;
     espnow_olsr_event_info_t info;
@@ -79,6 +91,7 @@ typedef enum {
     ESPNOW_OLSR_DATA_MORE, // more frames will follow to form a full packet.
     ESPNOW_OLSR_DATA_END,
     ESPNOW_OLSR_DATA_S_END, // only one frame.
+    ESPNOW_OLSR_DATA_PARITY, // XOR of the frames in a parity group, sent after the last frame.
 } espnow_seg_state_t; // packet segmentation state
 
 /* User defined field of ESPNOW data in this example. */
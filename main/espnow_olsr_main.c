@@ -31,10 +31,28 @@
 
 #include "espnow_olsr.h"
 #include "libs/olsr_handlers.h"
+#include "libs/arena.h"
+#include "libs/reassembly.h"
+#include "libs/rx_ring.h"
+#include "libs/tx_sched.h"
+#include "libs/peer_cache.h"
 
 static const char *TAG = "espnow_event_loop";
 
-static xQueueHandle s_espnow_olsr_queue;
+static TaskHandle_t s_espnow_olsr_task;
+// timer slots, from the timer task to the event loop.
+static xQueueHandle s_timer_queue;
+// received frames, from the WiFi task to the event loop.
+static rx_ring_t s_rx_ring;
+// packets to be sent, the send cb moves its window.
+static tx_sched_t s_tx_sched;
+// peers of unicast packets.
+static peer_cache_t s_peer_cache;
+
+// the PHY rates of the rate control ladder, from the most robust to the fastest.
+static const wifi_phy_rate_t s_phy_rate_list[RATE_CTRL_RATE_NUM] = {
+    WIFI_PHY_RATE_1M_L, WIFI_PHY_RATE_6M, WIFI_PHY_RATE_12M, WIFI_PHY_RATE_24M, WIFI_PHY_RATE_MCS4_SGI, WIFI_PHY_RATE_MCS7_SGI,
+};
 
 static uint8_t espnow_broadcast_mac[RFC5444_ADDR_LEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 static uint16_t s_espnow_olsr_seq = 0;
@@ -57,62 +75,52 @@ static void example_wifi_init(void)
     int8_t power = 0;
     ESP_ERROR_CHECK( esp_wifi_get_max_tx_power(&power) );
     ESP_LOGI(TAG, "Default max power =%d * 0.25dbm", power);
-    ESP_ERROR_CHECK( esp_wifi_set_max_tx_power(8) );
+    ESP_ERROR_CHECK( esp_wifi_set_max_tx_power(ESPNOW_TX_POWER) );
     ESP_ERROR_CHECK( esp_wifi_get_max_tx_power(&power) );
     ESP_LOGI(TAG, "New max tx power =%d * 0.25dbm", power);
 
-    /*set the rate*/
-    ESP_ERROR_CHECK( esp_wifi_internal_set_fix_rate(ESPNOW_WIFI_IF, true, WIFI_PHY_RATE_MCS7_SGI) );
+    /*set the rate, the tx scheduler switches it for each packet*/
+    ESP_ERROR_CHECK( esp_wifi_internal_set_fix_rate(ESPNOW_WIFI_IF, true, s_phy_rate_list[RATE_CTRL_INIT_RATE]) );
+}
+
+// the driver sends all frames at one fixed rate, called by the tx scheduler between packets.
+static void set_phy_rate(uint8_t rate)
+{
+    esp_err_t err = esp_wifi_internal_set_fix_rate(ESPNOW_WIFI_IF, true, s_phy_rate_list[rate]);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Set PHY rate #%d error %d", rate, err);
+    }
 }
 
 /* ESPNOW sending or receiving callback function is called in WiFi task.
  * Users should not do lengthy operations from this task. Instead, post
  * necessary data to a queue and handle it from a lower priority task. */
+// a frame left the driver, wake up the event loop to send more.
 static void espnow_olsr_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    espnow_olsr_event_t evt;
-    espnow_olsr_event_send_cb_t *send_cb = &evt.info.send_cb;
-
     if (mac_addr == NULL) {
         ESP_LOGE(TAG, "Send cb arg error");
         return;
     }
-    if (status == ESP_NOW_SEND_FAIL) {
-        ESP_LOGE(TAG, "Send espnow frame failed!");
-    }
-
-    evt.id = ESPNOW_OLSR_SEND_CB;
-    memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    send_cb->status = status;
 
-    // stop send this event.
-    // if (xQueueSend(s_espnow_olsr_queue, &evt, portMAX_DELAY) != pdTRUE) {
-    //     ESP_LOGW(TAG, "Send send queue fail");
-    // }
+    // the event loop pumps all frames it can once woken up, so only wake it up once.
+    if (tx_sched_send_done(&s_tx_sched, mac_addr, status)) {
+        xTaskNotifyGive(s_espnow_olsr_task);
+    }
 }
 
+// copy the frame into the rx ring and wake up the event loop, never blocks the WiFi task.
 static void espnow_olsr_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
 {
-    espnow_olsr_event_t evt;
-    espnow_olsr_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
-
     if (mac_addr == NULL || data == NULL || len <= 0) {
         ESP_LOGE(TAG, "Receive cb arg error");
         return;
     }
 
-    evt.id = ESPNOW_OLSR_RECV_CB;
-    memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL) {
-        ESP_LOGE(TAG, "Malloc receive data fail");
-        return;
-    }
-    memcpy(recv_cb->data, data, len);
-    recv_cb->data_len = len;
-    if (xQueueSend(s_espnow_olsr_queue, &evt, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send receive queue fail");
-        free(recv_cb->data);
+    // a full ring drops the frame, the drops are counted in the ring and logged by the event loop.
+    // the event loop drains the whole ring once woken up, so only wake it up once.
+    if (rx_ring_push(&s_rx_ring, mac_addr, data, len) && rx_ring_need_wake(&s_rx_ring)) {
+        xTaskNotifyGive(s_espnow_olsr_task);
     }
 }
 
@@ -140,8 +148,8 @@ int espnow_olsr_data_check(uint8_t *data, uint16_t data_len)
     return -1;
 }
 
-/* Prepare ESPNOW data to be sent. */
-void espnow_olsr_frame_prepare(espnow_olsr_frame_t *espnow_frame, espnow_seg_state_t state, uint8_t* payload, uint8_t payload_len)
+/* Prepare ESPNOW data to be sent. The payload is already in place, only fill the frame header. */
+void espnow_olsr_frame_prepare(espnow_olsr_frame_t *espnow_frame, espnow_seg_state_t state, uint8_t payload_len)
 {
     assert(espnow_frame != NULL); // please also make sure it has enough space.
     assert(payload_len <= ESPNOW_MAX_PAYLOAD_LEN);
@@ -150,257 +158,265 @@ void espnow_olsr_frame_prepare(espnow_olsr_frame_t *espnow_frame, espnow_seg_sta
     espnow_frame->seg_state = state;
     espnow_frame->crc = 0;
     espnow_frame->len = payload_len + sizeof(espnow_olsr_frame_t);
-    memcpy(espnow_frame->payload, payload, payload_len); 
     espnow_frame->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)espnow_frame, espnow_frame->len);
 }
 
-static void espnow_olsr_task(void *pvParameter)
+// XOR the payloads of the frames in a parity group into a parity payload, return its len.
+// the last frame is shorter, it is padded with zeros.
+static uint8_t gen_parity_payload(raw_pkt_t pkt, uint8_t seg_num, uint8_t group, uint8_t *parity)
+{
+    uint8_t parity_len = 0;
+    memset(parity, 0, ESPNOW_MAX_PAYLOAD_LEN);
+    for (int p = group; p < seg_num; p += ESPNOW_FEC_GROUP_NUM) {
+        uint8_t *payload = pkt.pkt_data + p * ESPNOW_MAX_DATA_LEN + sizeof(espnow_olsr_frame_t);
+        uint8_t payload_len = (p == seg_num - 1) ? pkt.pkt_len - p * ESPNOW_MAX_PAYLOAD_LEN : ESPNOW_MAX_PAYLOAD_LEN;
+        for (int b = 0; b < payload_len; b++) {
+            parity[b] ^= payload[b];
+        }
+        if (payload_len > parity_len) parity_len = payload_len;
+    }
+    return parity_len;
+}
+
+// the ESPNOW peer of a queued packet must stay in the driver until the packet is sent.
+static uint8_t has_queued_pkt(const uint8_t mac_addr[RFC5444_ADDR_LEN])
 {
-    espnow_olsr_event_t evt;
-    espnow_olsr_frame_t *local_frame = NULL; 
+    return tx_sched_has_dest(&s_tx_sched, mac_addr);
+}
+
+static uint8_t is_kept_peer(const uint8_t mac_addr[RFC5444_ADDR_LEN])
+{
+    return is_neighbor_mac(mac_addr) || has_queued_pkt(mac_addr);
+}
+
+// prepare the frame headers of a packet from handlers and queue it to the tx scheduler.
+// the payload of each frame is already in the framed buf, the tx scheduler frees it once sent.
+static void queue_tx_pkt(raw_pkt_t pkt)
+{
+    espnow_olsr_frame_t *tx_frame = NULL;
     uint8_t pkt_seg_num = 0; // how many seg in a packet.
 
-    // for recv packet
-    uint8_t recv_mac_addr[ESP_NOW_ETH_ALEN];
-    memcpy(recv_mac_addr, espnow_broadcast_mac, ESP_NOW_ETH_ALEN);
-    uint16_t recv_seq_num = 0;
-    uint8_t *recv_pkt_buf = NULL;
-    uint16_t recv_pkt_offset = 0;
+    if (pkt.pkt_len == 0) return;
+    // calculate number of frames/segments needed for this packet.
+    pkt_seg_num = ESPNOW_SEG_NUM(pkt.pkt_len);
+    assert(pkt_seg_num >= 1 && pkt_seg_num <= 16); // it should not be very large.
+
+    // loop over segments/frames
+    for (int p = 0; p < pkt_seg_num; p++) {
+        tx_frame = (espnow_olsr_frame_t *)(pkt.pkt_data + p * ESPNOW_MAX_DATA_LEN);
+        // Is this the last segment/frame?
+        if (p == pkt_seg_num - 1) {
+            // first and also the last
+            espnow_olsr_frame_prepare(tx_frame, (p == 0) ? ESPNOW_OLSR_DATA_S_END : ESPNOW_OLSR_DATA_END,\
+                                      pkt.pkt_len - p * ESPNOW_MAX_PAYLOAD_LEN);
+        } else {
+            // if first frame of multiple ones
+            espnow_olsr_frame_prepare(tx_frame, (p == 0) ? ESPNOW_OLSR_DATA_START : ESPNOW_OLSR_DATA_MORE,\
+                                      ESPNOW_MAX_PAYLOAD_LEN);
+        }
+    }
+    // parity frames follow in the order of their groups, their seq nums follow the last frame.
+    for (int g = 0; g < ESPNOW_PARITY_NUM(pkt_seg_num); g++) {
+        tx_frame = (espnow_olsr_frame_t *)(pkt.pkt_data + (pkt_seg_num + g) * ESPNOW_MAX_DATA_LEN);
+        espnow_olsr_frame_prepare(tx_frame, ESPNOW_OLSR_DATA_PARITY, gen_parity_payload(pkt, pkt_seg_num, g, tx_frame->payload));
+    }
+    // a unicast packet needs its peer in the driver, broadcast it if the peer can not be added.
+    if (memcmp(pkt.mac_addr, espnow_broadcast_mac, RFC5444_ADDR_LEN) != 0 && !peer_cache_use(&s_peer_cache, pkt.mac_addr, has_queued_pkt)) {
+        memcpy(pkt.mac_addr, espnow_broadcast_mac, RFC5444_ADDR_LEN);
+    }
+    tx_sched_push(&s_tx_sched, pkt, rate_ctrl_get_rate(&link_rate_ctrl, pkt.mac_addr));
+}
+
+// the output of handlers goes straight to the tx stage, never back to the event loop.
+static void dispatch_handler_evt(espnow_olsr_event_t *ret_evt)
+{
+    if (ret_evt->id != ESPNOW_OLSR_SEND_TO) return;
+    for (int p = 0; p < ret_evt->info.send_to.pkt_num; p++) {
+        queue_tx_pkt(ret_evt->info.send_to.pkt_list[p]);
+    }
+}
 
-    // for handler return event
+// check a received frame and pass the packet to the recv handler once it is complete.
+static void handle_rx_frame(rx_frame_t *rx_frame, reasm_table_t *reasm_table_ptr)
+{
     espnow_olsr_event_t ret_evt;
-    
+    reasm_slot_t *reasm_slot = NULL;
+
+    if (espnow_olsr_data_check(rx_frame->data, rx_frame->data_len) < 0 ) {
+        ESP_LOGE(TAG, "Recv data check failed. len = %d", rx_frame->data_len);
+        return;
+    }
+    // check done, get frame now
+    espnow_olsr_frame_t *recv_frame = (espnow_olsr_frame_t *)rx_frame->data;
+    // print recv info
+    ESP_LOGI(TAG, "Receive %dth broadcast data from: "MACSTR", len: %d",\
+                recv_frame->seq_num, MAC2STR(rx_frame->mac_addr), rx_frame->data_len);
+
+    // handle segments
+    switch (recv_frame->seg_state)
+    {
+    case ESPNOW_OLSR_DATA_S_END: {
+        // this case does not involve pkt buf
+        // call olsr recv packet handler
+        raw_pkt_t recv_pkt;
+        memcpy(recv_pkt.mac_addr, rx_frame->mac_addr, RFC5444_ADDR_LEN);
+        recv_pkt.pkt_len = recv_frame->len - sizeof(espnow_olsr_frame_t);
+        recv_pkt.pkt_data = recv_frame->payload;
+        ret_evt = olsr_recv_pkt_handler(recv_pkt);
+        dispatch_handler_evt(&ret_evt);
+        break;
+    }
+    case ESPNOW_OLSR_DATA_START:
+    case ESPNOW_OLSR_DATA_MORE:
+    case ESPNOW_OLSR_DATA_END:
+    case ESPNOW_OLSR_DATA_PARITY: {
+        reasm_slot = reasm_add_frame(reasm_table_ptr, rx_frame->mac_addr, recv_frame,\
+                                     xTaskGetTickCount() * portTICK_PERIOD_MS);
+        if (reasm_slot == NULL) break;
+        // call recv pkt handler
+        ret_evt = olsr_recv_pkt_handler(reasm_slot->pkt);
+        dispatch_handler_evt(&ret_evt);
+        // clean up the slot
+        reasm_free_slot(reasm_table_ptr, reasm_slot);
+        break;
+    }
+    default:
+        ESP_LOGE(TAG, "Recv frame seg_state unknown");
+        break;
+    }
+}
+
+// handle at most max_num frames in the rx ring as a batch. return 1 if there are frames left.
+static uint8_t drain_rx_ring(reasm_table_t *reasm_table_ptr, uint8_t max_num)
+{
+    rx_frame_t *rx_frame = NULL;
+    uint8_t frame_num = 0;
+    rx_ring_clear_wake(&s_rx_ring);
+    while (frame_num < max_num && (rx_frame = rx_ring_peek(&s_rx_ring)) != NULL) {
+        handle_rx_frame(rx_frame, reasm_table_ptr);
+        rx_ring_pop(&s_rx_ring);
+        frame_num ++;
+        // objects drawn by the handlers die with the frame.
+        arena_reset(&event_arena);
+    }
+    return rx_ring_peek(&s_rx_ring) != NULL;
+}
+
+// handle a timer slot and log the stats once per tick.
+static void handle_timer_slot(uint32_t timer_slot, reasm_table_t *reasm_table_ptr)
+{
+    espnow_olsr_event_t ret_evt;
+
+    if (timer_slot % TIMER_SLOTS_PER_TICK == 0) {
+        ESP_LOGI(TAG, "Handling timer slot #%d. event arena high water = %d, fails = %d, reassembly drops = %d, rebuilt frames = %d, rx ring drops = %d",\
+                    timer_slot, event_arena.high_water, event_arena.fail_num, reasm_table_ptr->drop_num, reasm_table_ptr->rebuilt_num, s_rx_ring.drop_num);
+        ESP_LOGI(TAG, "tx queued = %d, sent = %d, retries = %d, drops = %d, send fails = %d, unicast peers = %d, peer evictions = %d",\
+                    s_tx_sched.pkt_num, s_tx_sched.sent_num, s_tx_sched.retry_num, s_tx_sched.drop_num, s_tx_sched.fail_num,\
+                    s_peer_cache.peer_num, s_peer_cache.evict_num);
+        ESP_LOGI(TAG, "broadcast rate = #%d, rate links = %d, steps up = %d, steps down = %d, send cb drops = %d",\
+                    rate_ctrl_get_rate(&link_rate_ctrl, espnow_broadcast_mac), link_rate_ctrl.link_num,\
+                    link_rate_ctrl.up_num, link_rate_ctrl.down_num, s_tx_sched.result_drop_num);
+        // the peers and the rate links follow the neighbor set, the peers of queued packets are kept until they are sent.
+        peer_cache_prune(&s_peer_cache, is_kept_peer);
+        rate_ctrl_prune(&link_rate_ctrl, is_neighbor_mac);
+    }
+    // call olsr handler
+    ret_evt = olsr_timer_handler(timer_slot);
+    dispatch_handler_evt(&ret_evt);
+    // objects drawn by the handler die with the slot.
+    arena_reset(&event_arena);
+}
+
+static void espnow_olsr_task(void *pvParameter)
+{
+    uint32_t timer_slot = 0;
+    uint8_t rx_left = 0; // frames left in the rx ring after a batch.
+    // how long to wait for the next event before the tx scheduler has to pump again.
+    uint32_t tx_wait_ms = TX_WAIT_FOREVER;
+    TickType_t wait_ticks = portMAX_DELAY;
+    tx_result_t tx_result;
+
+    // for recv packet, frames of packets from different senders may interleave.
+    reasm_table_t reasm_table;
+
+    // per-event arena for handlers, reset after each event.
+    uint8_t *event_arena_buf = NULL;
+
     // why wait? this is from the example code.
     vTaskDelay(100 / portTICK_RATE_MS);
     ESP_LOGI(TAG, "ESPNOW event loop starts");
 
-    /* Initialize an empty frame to hold data for local use  */
-    local_frame = malloc(ESPNOW_MAX_DATA_LEN);
-    if (local_frame == NULL) {
-        ESP_LOGE(TAG, "frame alloc failed");
-        espnow_olsr_deinit();
-        vTaskDelete(NULL);
-    }
-    memset(local_frame, 0, ESPNOW_MAX_DATA_LEN);
-    /* Initialize an empty packet to hold data for recv buf  */
-    recv_pkt_buf = malloc(ESPNOW_MAX_PKT_LEN);
-    if (recv_pkt_buf == NULL) {
-        ESP_LOGE(TAG, "packet buf alloc failed");
-        free(local_frame);
+    /* Initialize the reassembly table, slot bufs are malloced when packets start */
+    reasm_init(&reasm_table);
+    tx_sched_init(&s_tx_sched, set_phy_rate);
+    rate_ctrl_init(&link_rate_ctrl);
+    peer_cache_init(&s_peer_cache);
+    /* Initialize the event arena */
+    event_arena_buf = malloc(EVENT_ARENA_SIZE);
+    if (event_arena_buf == NULL) {
+        ESP_LOGE(TAG, "event arena alloc failed");
         espnow_olsr_deinit();
         vTaskDelete(NULL);
     }
-    memset(recv_pkt_buf, 0, ESPNOW_MAX_PKT_LEN);
+    arena_init(&event_arena, event_arena_buf, EVENT_ARENA_SIZE);
 
 
     // espnow event loop, should loop forever.
-    while (xQueueReceive(s_espnow_olsr_queue, &evt, portMAX_DELAY) == pdTRUE) {
+    // the timer, the WiFi task and the send cbs notify this task, each one has its own queue.
+    // the queues are served by priority, so that a flood of received frames does not delay the timer slots.
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, wait_ticks);
         // ESP_LOGI(TAG, "RAM left %d", esp_get_free_heap_size());
         // ESP_LOGI(TAG, "task stack water mark : %d", uxTaskGetStackHighWaterMark(NULL));
-        switch (evt.id) {
-            // a packet need to be sent, most likely we need send multiple frames
-            case ESPNOW_OLSR_SEND_TO:
-            {
-                espnow_olsr_event_send_to_t *send_to_info = &evt.info.send_to;
-
-                ESP_LOGI(TAG, "Handling SEND_TO event");
-                if(send_to_info->pkt.pkt_len == 0) break;
-                // calculate number of frames/segments needed for this packet.
-                pkt_seg_num = (send_to_info->pkt.pkt_len + ESPNOW_MAX_PAYLOAD_LEN -1 )/ ESPNOW_MAX_PAYLOAD_LEN; 
-                assert(pkt_seg_num >= 1 && pkt_seg_num < 16); // it should not be very large.
-
-                /* prepare data and send out. */
-                // loop over segments/frames
-                for (int p = 0; p < pkt_seg_num; p++) {
-                    // Is this the last segment/frame?
-                    if (p == pkt_seg_num - 1) {
-                        // first and also the last
-                        if (p == 0) {
-                            espnow_olsr_frame_prepare(local_frame, ESPNOW_OLSR_DATA_S_END,\
-                                                  send_to_info->pkt.pkt_data, send_to_info->pkt.pkt_len);
-                        } else {
-                            espnow_olsr_frame_prepare(local_frame, ESPNOW_OLSR_DATA_END,\
-                                                  send_to_info->pkt.pkt_data + p * ESPNOW_MAX_PAYLOAD_LEN, send_to_info->pkt.pkt_len - p*ESPNOW_MAX_PAYLOAD_LEN);
-                        }
-                    } else {
-                        // if first frame of multiple ones
-                        if (p == 0) {
-                            espnow_olsr_frame_prepare(local_frame, ESPNOW_OLSR_DATA_START,\
-                                                  send_to_info->pkt.pkt_data, ESPNOW_MAX_PAYLOAD_LEN);
-                        } else {
-                            espnow_olsr_frame_prepare(local_frame, ESPNOW_OLSR_DATA_MORE,\
-                                                  send_to_info->pkt.pkt_data + p * ESPNOW_MAX_PAYLOAD_LEN, ESPNOW_MAX_PAYLOAD_LEN);
-                        }
-                    }
-                    // send the frame to broadcast address now 
-                    if (esp_now_send(espnow_broadcast_mac, (const uint8_t *)local_frame, local_frame->len) != ESP_OK) {
-                        ESP_LOGE(TAG, "ESPNOW Send error!");
-                        espnow_olsr_deinit();
-                        vTaskDelete(NULL);
-                    }
-                    // clear up
-                    memset(local_frame, 0, ESPNOW_MAX_DATA_LEN);
-                }
-                // MUST free the data
-                free(send_to_info->pkt.pkt_data);
-                break;
-            }
-            case ESPNOW_OLSR_SEND_CB:
-            {
-                // do nothing, this should not be called.
-                ESP_LOGI(TAG, "Handling SEND_CB event");
-                break;
-            }
-            case ESPNOW_OLSR_RECV_CB:
-            {
-                espnow_olsr_event_recv_cb_t *recv_cb_info = &evt.info.recv_cb;
-                assert(recv_cb_info != NULL);
-                ESP_LOGI(TAG, "Handling RECV_CB event");
-
-                if (espnow_olsr_data_check(recv_cb_info->data, recv_cb_info->data_len) < 0 ) {
-                    ESP_LOGE(TAG, "Recv data check failed. len = %d", recv_cb_info->data_len);
-                    break;
-                }
-                // check done, get frame now
-                espnow_olsr_frame_t *recv_frame = (espnow_olsr_frame_t *)recv_cb_info->data;
-                // print recv info
-                ESP_LOGI(TAG, "Receive %dth broadcast data from: "MACSTR", len: %d",\
-                            recv_frame->seq_num, MAC2STR(recv_cb_info->mac_addr), recv_cb_info->data_len);
-
-                // handle segments
-                switch (recv_frame->seg_state)
-                {
-                // handle segmets, what if we lose some segments?
-                case ESPNOW_OLSR_DATA_S_END: {
-                    // this case does not involve pkt buf
-                    // call olsr recv packet handler
-                    raw_pkt_t recv_pkt;
-                    memcpy(recv_pkt.mac_addr, recv_cb_info->mac_addr, RFC5444_ADDR_LEN);
-                    recv_pkt.pkt_len = recv_frame->len - sizeof(espnow_olsr_frame_t);
-                    recv_pkt.pkt_data = recv_frame->payload;
-                    // TODO: this is jsut a fake return value
-                    ret_evt = olsr_recv_pkt_handler(recv_pkt);
-                    // push to queue
-                    if (xQueueSend(s_espnow_olsr_queue, &ret_evt, portMAX_DELAY) != pdTRUE) {
-                        ESP_LOGW(TAG, "Send receive queue fail");
-                    }
-                    break;
-                }
-                case ESPNOW_OLSR_DATA_START: {
-                    if(recv_pkt_offset != 0) {
-                        ESP_LOGW(TAG, "A newpacket starts. Old packet is dropped!");
-                        // clean up the buf
-                        memset(recv_pkt_buf, 0, ESPNOW_MAX_PKT_LEN);
-                        recv_pkt_offset = 0;
-                    }
-                    // update all recv states
-                    uint8_t tmp_len = recv_frame->len - sizeof(espnow_olsr_frame_t);
-                    memcpy(recv_pkt_buf, recv_frame->payload, tmp_len);
-                    recv_pkt_offset += tmp_len;
-                    memcpy(recv_mac_addr, recv_cb_info->mac_addr, ESP_NOW_ETH_ALEN);
-                    recv_seq_num = recv_frame->seq_num;
-                    break;
-                }
-                case ESPNOW_OLSR_DATA_MORE: {
-                    int tmp_ret = memcmp(recv_mac_addr, recv_cb_info->mac_addr, ESP_NOW_ETH_ALEN);
-                    // the frame must be from the same mac, right seq_num and with right offset value
-                    if (tmp_ret != 0 || recv_seq_num != recv_frame->seq_num - 1 || recv_pkt_offset == 0) {
-                        ESP_LOGW(TAG, "A wrong frame with DATA_MORE flag!");
-                        break;
-                    }
-                    // update all recv states
-                    uint8_t tmp_len = recv_frame->len - sizeof(espnow_olsr_frame_t);
-                    memcpy(recv_pkt_buf + recv_pkt_offset, recv_frame->payload, tmp_len);
-                    recv_pkt_offset += tmp_len;
-                    recv_seq_num ++;
-                    break;
-                }
-                case ESPNOW_OLSR_DATA_END: {
-                    int tmp_ret = memcmp(recv_mac_addr, recv_cb_info->mac_addr, ESP_NOW_ETH_ALEN);
-                    // the frame must be from the same mac, right seq_num and with right offset value
-                    if (tmp_ret != 0 || recv_seq_num != recv_frame->seq_num - 1 || recv_pkt_offset == 0) {
-                        ESP_LOGW(TAG, "A wrong frame with DATA_END flag!");
-                        break;
-                    }
-                    // update all recv states
-                    uint8_t tmp_len = recv_frame->len - sizeof(espnow_olsr_frame_t);
-                    memcpy(recv_pkt_buf + recv_pkt_offset, recv_frame->payload, tmp_len);
-                    recv_pkt_offset += tmp_len;
-                    ESP_LOGI(TAG, "A new packet received, len = %d", recv_pkt_offset);
-                    // call recv pkt handler
-                    raw_pkt_t recv_pkt;
-                    memcpy(recv_pkt.mac_addr, recv_cb_info->mac_addr, RFC5444_ADDR_LEN);
-                    recv_pkt.pkt_len = recv_pkt_offset;
-                    recv_pkt.pkt_data = recv_pkt_buf;
-                    // TODO: this is jsut a fake return value
-                    ret_evt = olsr_recv_pkt_handler(recv_pkt);
-                    // push to queue
-                    if (xQueueSend(s_espnow_olsr_queue, &ret_evt, portMAX_DELAY) != pdTRUE) {
-                        ESP_LOGW(TAG, "Send receive queue fail");
-                    }
-                    // clean up the buf
-                    memset(recv_pkt_buf, 0, ESPNOW_MAX_PKT_LEN);
-                    recv_pkt_offset = 0;
-                    recv_seq_num = 0;
-                    break;
-                }
-                default:
-                    ESP_LOGE(TAG, "Recv frame seg_state unknown");
-                    break;
-                }
-
-                free(recv_frame); // MUST free data! this is allocated in recv_cb
-                break;
-            }
-            case ESPNOW_OLSR_TIMER_CB:
-            {
-                ESP_LOGI(TAG, "Handling TIMER CB event.");
-                // call olsr handler
-                ret_evt = olsr_timer_handler(evt.info.timer_cb.timer_tick);
-                // push the return event to queue
-                if (xQueueSend(s_espnow_olsr_queue, &ret_evt, portMAX_DELAY) != pdTRUE) {
-                    ESP_LOGE(TAG, "Timer send evt to queue fail!");
-                    return;
-                }
-                break;
-            }
-            case ESPNOW_OLSR_NO_OP: {
-                ESP_LOGI(TAG, "NO OP event called.");
-                break;
-            }
-            default:
-                ESP_LOGE(TAG, "Callback type error: %d", evt.id);
-                break;
+
+        // 1. timer slots, HELLO and TC msgs are emitted here.
+        while (xQueueReceive(s_timer_queue, &timer_slot, 0) == pdTRUE) {
+            handle_timer_slot(timer_slot, &reasm_table);
+        }
+        // 2. received frames, a batch at most, so the timer slots wait for one batch at most.
+        rx_left = drain_rx_ring(&reasm_table, ESPNOW_RX_BATCH_NUM);
+        // 3. send frames of the queued packets as the tx window allows, after the send cbs update the rates.
+        while (tx_sched_pop_result(&s_tx_sched, &tx_result)) {
+            rate_ctrl_on_tx(&link_rate_ctrl, tx_result.mac_addr, tx_result.is_acked);
+        }
+        tx_wait_ms = tx_sched_pump(&s_tx_sched, xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+        if (rx_left) {
+            wait_ticks = 0;
+        } else if (tx_wait_ms == TX_WAIT_FOREVER) {
+            wait_ticks = portMAX_DELAY;
+        } else {
+            // wake up in time to retry a frame if no send cb comes.
+            wait_ticks = (tx_wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
         }
     }
 
     // free local buf now
-    free(local_frame);
-    free(recv_pkt_buf);
+    tx_sched_deinit(&s_tx_sched);
+    peer_cache_deinit(&s_peer_cache);
+    reasm_deinit(&reasm_table);
+    free(event_arena_buf);
 }
 
-
 static void espnow_timer_cb( TimerHandle_t xExpiredTimer )
 {
-    static uint32_t timer_tick_count = 0;
+    static uint32_t timer_slot_count = 0;
     // Increment the variable to show the timer callback has executed.
-    timer_tick_count ++;
-    ESP_LOGI(TAG, "timer tick = %d", timer_tick_count);
-
-    // send TIMER_CB event, let the event loop do the heavy work.
-    espnow_olsr_event_t evt;
-    evt.id = ESPNOW_OLSR_TIMER_CB;
-    evt.info.timer_cb.timer_tick = timer_tick_count;
-    // push to queue
-    if (xQueueSend(s_espnow_olsr_queue, &evt, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGE(TAG, "Timer send evt to queue fail!");
+    timer_slot_count ++;
+    ESP_LOGD(TAG, "timer slot = %d", timer_slot_count);
+
+    // pass the slot to the event loop, let it do the heavy work.
+    // never block the timer task, the slot is skipped if the event loop falls behind.
+    if (xQueueSend(s_timer_queue, &timer_slot_count, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Timer queue full, skip slot %d", timer_slot_count);
         return;
     }
+    xTaskNotifyGive(s_espnow_olsr_task);
 
     /* legacy test code */
     // If this callback has executed the required number of times, stop the
     // timer.
-    // if( timer_tick_count == 100 )
+    // if( timer_slot_count == 100 )
     // {
     //     // This is called from a timer callback so must not block.
     //     xTimerStop( xExpiredTimer, 0 );
@@ -415,28 +431,20 @@ static void espnow_timer_cb( TimerHandle_t xExpiredTimer )
     //     ESP_LOGE(TAG, "packet alloc error!");
     //     return;
     // }
-    // espnow_olsr_event_t evt;
-    // evt.id = ESPNOW_OLSR_SEND_TO;
-    // evt.info.send_to.pkt = recv_pkt;
-    // // push to queue
-    // if (xQueueSend(s_espnow_olsr_queue, &evt, portMAX_DELAY) != pdTRUE) {
-    //     ESP_LOGW(TAG, "Send receive queue fail");
-    // }
+    // queue_tx_pkt(recv_pkt);
 }
 
 static esp_err_t espnow_olsr_init(void)
 {
 
-    s_espnow_olsr_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(espnow_olsr_event_t));
-    if (s_espnow_olsr_queue == NULL) {
+    s_timer_queue = xQueueCreate(ESPNOW_TIMER_QUEUE_SIZE, sizeof(uint32_t));
+    if (s_timer_queue == NULL) {
         ESP_LOGE(TAG, "Create mutex fail");
         return ESP_FAIL;
     }
 
-    /* Initialize ESPNOW and register sending and receiving callback function. */
+    /* Initialize ESPNOW, the callbacks are registered once the event loop task exists. */
     ESP_ERROR_CHECK( esp_now_init() );
-    ESP_ERROR_CHECK( esp_now_register_send_cb(espnow_olsr_send_cb) ); // Do we need this?
-    ESP_ERROR_CHECK( esp_now_register_recv_cb(espnow_olsr_recv_cb) );
 
     /* Set primary master key. */
     ESP_ERROR_CHECK( esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK) );
@@ -445,7 +453,7 @@ static esp_err_t espnow_olsr_init(void)
     esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
     if (peer == NULL) {
         ESP_LOGE(TAG, "Malloc peer information fail");
-        vSemaphoreDelete(s_espnow_olsr_queue);
+        vSemaphoreDelete(s_timer_queue);
         esp_now_deinit();
         return ESP_FAIL;
     }
@@ -463,7 +471,10 @@ static esp_err_t espnow_olsr_init(void)
     info_base_init(my_mac); // pass local mac addr
 
     // ==== start a task for OLSR event loop ====
-    xTaskCreate(espnow_olsr_task, "espnow_olsr_task", 4096, NULL, 4, NULL);
+    xTaskCreate(espnow_olsr_task, "espnow_olsr_task", 4096, NULL, 4, &s_espnow_olsr_task);
+    /* register sending and receiving callback function, they notify the event loop task. */
+    ESP_ERROR_CHECK( esp_now_register_send_cb(espnow_olsr_send_cb) );
+    ESP_ERROR_CHECK( esp_now_register_recv_cb(espnow_olsr_recv_cb) );
     // ==== set up a freeRTOS timer to send out packets. ====
     TimerHandle_t xTimer_h = xTimerCreate( "T1",             // Text name for the task.  Helps debugging only.  Not used by FreeRTOS.
                                  xTIMER_PERIOD,     // The period of the timer in ticks.
@@ -487,7 +498,7 @@ static esp_err_t espnow_olsr_init(void)
 
 static void espnow_olsr_deinit()
 {
-    vSemaphoreDelete(s_espnow_olsr_queue);
+    vSemaphoreDelete(s_timer_queue);
     esp_now_deinit();
 }
 
@@ -0,0 +1,44 @@
+#include <string.h>
+#include "esp_log.h"
+#include "arena.h"
+
+static const char *TAG = "espnow_arena";
+
+arena_t event_arena;
+
+void arena_init (arena_t* arena_ptr, uint8_t* buf, uint32_t size) {
+    arena_ptr->buf = buf;
+    arena_ptr->size = size;
+    arena_ptr->used = 0;
+    arena_ptr->high_water = 0;
+    arena_ptr->fail_num = 0;
+}
+
+// O(1) allocation, return NULL if the arena is full.
+void* arena_alloc (arena_t* arena_ptr, uint32_t size) {
+    uint32_t aligned_size = (size + ARENA_ALIGN - 1) & ~(uint32_t)(ARENA_ALIGN - 1);
+    if (arena_ptr->buf == NULL || arena_ptr->used + aligned_size > arena_ptr->size) {
+        ESP_LOGE(TAG, "No mem in arena! used = %d, size = %d", arena_ptr->used, size);
+        arena_ptr->fail_num ++;
+        return NULL;
+    }
+    void* ret_ptr = arena_ptr->buf + arena_ptr->used;
+    arena_ptr->used += aligned_size;
+    if (arena_ptr->used > arena_ptr->high_water) {
+        arena_ptr->high_water = arena_ptr->used;
+    }
+    return ret_ptr;
+}
+
+void* arena_calloc (arena_t* arena_ptr, uint32_t num, uint32_t size) {
+    void* ret_ptr = arena_alloc(arena_ptr, num * size);
+    if (ret_ptr != NULL) {
+        memset(ret_ptr, 0, num * size);
+    }
+    return ret_ptr;
+}
+
+// drop all allocations at once, called by the event loop after each event.
+void arena_reset (arena_t* arena_ptr) {
+    arena_ptr->used = 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * a bump allocator for objects that only live for one event.
+ * The event loop resets it after each event, so nothing needs to be freed.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+#include <stdint.h>
+
+#define EVENT_ARENA_SIZE    4096    // bytes of the arena owned by the event loop, the views of a packet of many msgs fit
+#define ARENA_ALIGN         4       // every allocation is aligned to 4 bytes
+
+typedef struct arena_t {
+    uint8_t* buf;
+    uint32_t size;
+    uint32_t used;
+    uint32_t high_water;    // the max bytes used by one event since init
+    uint32_t fail_num;      // num of allocations that did not fit
+} arena_t;
+
+// the arena for handlers, owned and reset by the event loop.
+extern arena_t event_arena;
+
+void arena_init (arena_t* arena_ptr, uint8_t* buf, uint32_t size);
+void* arena_alloc (arena_t* arena_ptr, uint32_t size);
+void* arena_calloc (arena_t* arena_ptr, uint32_t num, uint32_t size);
+void arena_reset (arena_t* arena_ptr);
+
+#endif
@@ -1,40 +1,119 @@
 #include "info_base.h"
+#include "arena.h"
 
 // set this to 0 if you want less MPR logs
 #define VERBOSE_MPR 0
+// set this to 1 to check the id lists against the node table after each change, it walks all peers.
+#define VERIFY_ID_LISTS 0
 
 static const char *TAG = "espnow_info_base";
 
+// HELLO tlv blocks, see the schemas in rfc5444.h
+#define HELLO_MSG_TLV_SCHEMA(X) \
+    X(VALIDITY_TIME,    HELLO_VALIDITY_TICKS) \
+    X(INTERVAL_TIME,    HELLO_INTERVAL_TICKS) \
+    X(MPR_WILLING,      IS_MPR_WILLING)
+// a delta HELLO also has the seq num of its full HELLO.
+#define HELLO_DELTA_MSG_TLV_SCHEMA(X) \
+    HELLO_MSG_TLV_SCHEMA(X) \
+    X(HELLO_BASE_SEQ,   hello_full_seq_num)
+#define HELLO_ADDR_TLV_SCHEMA(X) \
+    X(LINK_STATUS) \
+    X(LINK_METRIC) \
+    X(MPR_STATUS)
+// the bit-packed form, 1 byte of status and 3 bytes of metrics per link, or 3 bytes in all if
+// all links have the same metrics.
+#define HELLO_PACKED_ADDR_TLV_SCHEMA(X) \
+    X(LINK_MPR_STATUS) \
+    X(COMP_LINK_METRIC)
+DEFINE_MSG_TLV_SCHEMA(hello_msg_tlv_schema, HELLO_MSG_TLV_SCHEMA)
+DEFINE_MSG_TLV_SCHEMA(hello_delta_msg_tlv_schema, HELLO_DELTA_MSG_TLV_SCHEMA)
+DEFINE_ADDR_TLV_SCHEMA(hello_addr_tlv_schema, HELLO_ADDR_TLV_SCHEMA)
+DEFINE_ADDR_TLV_SCHEMA(hello_packed_addr_tlv_schema, HELLO_PACKED_ADDR_TLV_SCHEMA)
+
+// the values of one link in a HELLO addr tlv block.
+typedef struct hello_link_value_t {
+    uint8_t link_status;
+    uint8_t link_metric;
+    uint8_t in_link_metric;
+    uint8_t flooding_status;
+    uint8_t routing_status;
+} hello_link_value_t;
+
 // static variables should be init as zeros by the compiler.
 
 // message seq num, to indicate a new msg
-uint32_t global_msg_seq_num = 0;
+uint16_t global_msg_seq_num = 0;
 
 uint32_t global_tick_num = 0; // time counter based on tick
 
 // do not use #0, use [1, peer_num]
 // for example, 'for(int n=1; n <= peer_num; n++)'
+// ids are recycled, peer_num is the largest id in use, ids below it may be free.
 uint8_t peer_num = 0; // 255 should be enough.
 
 // a static list for all peer nodes' addresses.
 // Note: We use peer_id #0 to mark empty or originator(self)!
 uint8_t peer_addr_list[MAX_PEER_NUM][RFC5444_ADDR_LEN]; // use peer_id to get mac address.
-void* entry_ptr_list[MAX_PEER_NUM];
+// an open addressing hash table to get the peer_id of a mac address, with linear probing.
+// it holds peer ids, #0 marks an empty slot. it is at most half full, so probes are short.
+static uint8_t peer_hash_table[PEER_HASH_SIZE];
+// the generation of each peer_id, bumped when it is freed, so that an id kept across events can be checked.
+// ids in the link infos, the routing infos and the last full HELLO are never freed, see reclaim_peer_ids().
+uint8_t peer_gen_list[MAX_PEER_NUM];
+// the free ids in [1, peer_num], a bit for each id. the lowest one is used first, so that ids stay dense.
+static uint32_t free_id_mask[MAX_PEER_NUM / 32];
+
+// the node table, indexed by peer_id. see info_base.h
+uint8_t entry_type_list[MAX_PEER_NUM];      // NO_ENTRY for a free id
+uint32_t valid_until_list[MAX_PEER_NUM];
+uint16_t msg_seq_num_list[MAX_PEER_NUM];
+uint8_t link_status_list[MAX_PEER_NUM];
+uint8_t flooding_status_list[MAX_PEER_NUM];
+uint8_t routing_status_list[MAX_PEER_NUM];
+link_info_t link_info_list[MAX_PEER_NUM];
+routing_info_t routing_info_list[MAX_PEER_NUM];
+neighbor_entry_t neighbor_entry_list[MAX_PEER_NUM];
+
+// the entries are hashed into a timing wheel by valid_until, so that only the entries of the ticks passed are checked.
+// a wheel slot is a list of peer ids linked by expiry_next_list and expiry_prev_list, #0 ends it.
+// an entry valid for more than EXPIRY_WHEEL_SIZE ticks stays in its slot for more rounds.
+static uint8_t expiry_wheel[EXPIRY_WHEEL_SIZE];
+static uint8_t expiry_next_list[MAX_PEER_NUM];
+static uint8_t expiry_prev_list[MAX_PEER_NUM];
+static uint32_t expiry_tick_num = 0; // the slots of the ticks before it have been checked
+
+// the topology graph in the CSR way, the links of all nodes are in one pool of edges.
+// the links of a node are a row of successive edges, link_info_list[p] points to the row of node #p.
+// a row is rewritten in place if the new links fit, otherwise a new row is taken from the end of the pool
+// and the old one is left as a hole. the holes are squeezed out when the end of the pool is reached.
+static uint8_t edge_id_pool[MAX_EDGE_NUM];
+static uint8_t edge_metric_pool[MAX_EDGE_NUM];
+static uint8_t edge_in_metric_pool[MAX_EDGE_NUM];
+static uint16_t edge_end = 0;       // the edges before it are in rows or holes
+static uint16_t edge_hole_num = 0;
+static uint16_t edge_link_num = 0;  // links of all rows, what is left once the pool is compacted
+// the new links of a node are put here first, the old ones may still be read.
+static uint8_t staged_id_list[UINT8_MAX];
+static uint8_t staged_metric_list[UINT8_MAX];
+static uint8_t staged_in_metric_list[UINT8_MAX];
 
 // Neighbor Information Base
-// info is stored in entries, get it from entry ptr list.
+// info is stored in the node table, get the ids of each type from the id lists.
 uint8_t neighbor_id_num = 0;
 uint8_t neighbor_id_list[MAX_NEIGHBOUR_NUM];
 uint8_t two_hop_id_num = 0;
 uint8_t two_hop_id_list[MAX_PEER_NUM];
 
 // Topology Information Base
-// get remote_node_entry for the info !
+// get the node table for the info !
 // 1. A Routable Address Topology Set
 // 2. A Router Topology Set, recording links between routers in the MANET
 // 3. A Routing Set, recording routes from this router to all available destinations.
 uint8_t remote_id_num = 0;
 uint8_t remote_id_list[MAX_PEER_NUM];
+// the index of each entry in the id list of its type. the lists follow entry_type_list, see set_entry_type().
+static uint8_t id_list_idx_list[MAX_PEER_NUM];
 // TODO: 
 // 3. An Attached Network Set, recording a gateway
 
@@ -43,195 +122,348 @@ uint8_t remote_id_list[MAX_PEER_NUM];
 
 // Local Information Base: Originator address / my own address
 uint8_t originator_addr[RFC5444_ADDR_LEN];
+// the bounds of the addr ranges of split msgs, see gen_msg_part_range().
+static const uint8_t zero_addr[RFC5444_ADDR_LEN] = {0};
+static const uint8_t broadcast_addr[RFC5444_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+// HELLO delta state, the neighbor set advertised in the last full HELLO.
+uint16_t hello_full_seq_num = 0;
+uint8_t hello_delta_num = HELLO_FULL_INTERVAL_NUM; // num of delta HELLOs sent since the last full one, start with a full one
+uint8_t hello_adv_id_num = 0;
+uint8_t hello_adv_id_list[MAX_NEIGHBOUR_NUM];
 
 /* Helper functions */
 
+// FNV-1a of the mac address, the low bytes differ the most between nodes of the same vendor.
+static inline uint32_t hash_mac (const uint8_t mac_addr[RFC5444_ADDR_LEN]) {
+    uint32_t hash = 2166136261u;
+    for (int b = 0; b < RFC5444_ADDR_LEN; b++) {
+        hash = (hash ^ mac_addr[b]) * 16777619u;
+    }
+    return hash;
+}
+
+// the slot of the addr in the peer hash table, or the empty slot it should be put in.
+static uint32_t find_peer_slot (const uint8_t mac_addr[RFC5444_ADDR_LEN]) {
+    uint32_t slot = hash_mac(mac_addr) & (PEER_HASH_SIZE - 1);
+    while (peer_hash_table[slot] != 0 && memcmp(peer_addr_list[peer_hash_table[slot]], mac_addr, RFC5444_ADDR_LEN) != 0) {
+        slot = (slot + 1) & (PEER_HASH_SIZE - 1);
+    }
+    return slot;
+}
+
+// delete the addr in a slot of the peer hash table, the following addrs are shifted back
+// so that no probe sequence is broken.
+static void remove_peer_slot (uint32_t slot) {
+    uint32_t next = slot;
+    peer_hash_table[slot] = 0;
+    while (1) {
+        next = (next + 1) & (PEER_HASH_SIZE - 1);
+        if (peer_hash_table[next] == 0) return;
+        uint32_t home = hash_mac(peer_addr_list[peer_hash_table[next]]) & (PEER_HASH_SIZE - 1);
+        // it can fill the hole if the hole is between its home slot and it.
+        if (((next - home) & (PEER_HASH_SIZE - 1)) >= ((next - slot) & (PEER_HASH_SIZE - 1))) {
+            peer_hash_table[slot] = peer_hash_table[next];
+            peer_hash_table[next] = 0;
+            slot = next;
+        }
+    }
+}
+
+// get a free peer_id, the lowest one, or a new one after peer_num.
+// return 0 if all ids are in use.
+static uint8_t alloc_peer_id () {
+    for (int w = 0; w < MAX_PEER_NUM / 32; w++) {
+        if (free_id_mask[w] == 0) continue;
+        uint8_t peer_id = w * 32 + __builtin_ctz(free_id_mask[w]);
+        free_id_mask[w] &= ~(1u << (peer_id % 32));
+        return peer_id;
+    }
+    if (peer_num == MAX_PEER_NUM - 1) return 0;
+    return ++peer_num;
+}
+
+// free a peer_id without entry, peer_num shrinks if the largest ids are free.
+static void free_peer_id (uint8_t peer_id) {
+    remove_peer_slot(find_peer_slot(peer_addr_list[peer_id]));
+    peer_gen_list[peer_id] ++;
+    free_id_mask[peer_id / 32] |= 1u << (peer_id % 32);
+    while (peer_num > 0 && (free_id_mask[peer_num / 32] & (1u << (peer_num % 32)))) {
+        free_id_mask[peer_num / 32] &= ~(1u << (peer_num % 32));
+        peer_num --;
+    }
+}
+
 // search for the addr in the peer list, (if not existing, append one) and assign the peer_id.
-// return 1 if already in list, else 0.
+// return 1 if already in list, else 0. peer_id is 0 if there is no free id.
 uint8_t get_or_create_id (uint8_t mac_addr[RFC5444_ADDR_LEN], uint8_t* peer_id) {
-    for(int p = 1; p <= peer_num; p++) { // do not use #0, use [1, peer_num]
-        if (memcmp(peer_addr_list[p], mac_addr, RFC5444_ADDR_LEN) == 0) {
-            // a match in the list.
-            *peer_id = p;
-            if (entry_ptr_list[p] == NULL) {
-                // if this node was deleted before.
-                return 0; // register it agagin.
-            }
-            // do not need alloc new entry
-            return 1;
+    uint32_t slot = find_peer_slot(mac_addr);
+    if (peer_hash_table[slot] != 0) {
+        // a match in the list.
+        *peer_id = peer_hash_table[slot];
+        if (entry_type_list[*peer_id] == NO_ENTRY) {
+            // if this node was deleted before.
+            return 0; // register it agagin.
         }
+        // do not need alloc new entry
+        return 1;
     }
-    // if no match, append the list
-    memcpy(peer_addr_list[++peer_num], mac_addr, RFC5444_ADDR_LEN);
-    *peer_id = peer_num;
+    // if no match, take a free id
+    *peer_id = alloc_peer_id();
+    if (*peer_id == 0) {
+        ESP_LOGE(TAG, "No free peer id for "MACSTR" .", MAC2STR(mac_addr));
+        return 0;
+    }
+    memcpy(peer_addr_list[*peer_id], mac_addr, RFC5444_ADDR_LEN);
+    peer_hash_table[slot] = *peer_id;
     return 0;
 
 }
 
-// register a new neighbor struct into the entry_ptr_list, id_list needs to be updated later.
-neighbor_entry_t* register_new_neighbor(uint8_t new_neighbor_id) {
-    if (new_neighbor_id == 0 ) {
-        ESP_LOGW(TAG, "Do not register peer #0!");
-        return NULL;
+static inline void mark_id (uint32_t* mask, uint8_t peer_id) {
+    mask[peer_id / 32] |= 1u << (peer_id % 32);
+}
+
+// free the ids without entry which no link info, routing info or the last full HELLO refers to,
+// so that no id in the info base is stale and the table follows the live peers.
+void reclaim_peer_ids () {
+    uint32_t used_mask[MAX_PEER_NUM / 32] = {0};
+    for (int p = 1; p <= peer_num; p++) { // do not use #0
+        if (entry_type_list[p] == NO_ENTRY) continue;
+        mark_id(used_mask, p);
+        for (int l = 0; l < link_info_list[p].link_num; l++) {
+            mark_id(used_mask, link_info_list[p].id_list_ptr[l]);
+        }
+        mark_id(used_mask, routing_info_list[p].next_hop);
     }
-    // must be unregistered
-    assert(entry_ptr_list[new_neighbor_id] == NULL);
-    neighbor_entry_t* ret_entry = calloc(1, sizeof(neighbor_entry_t)); // set to zeros
-    if(ret_entry == NULL) {
-        ESP_LOGE(TAG, "No mem for a new neighbor entry.");
-        return NULL;
+    for (int a = 0; a < hello_adv_id_num; a++) {
+        mark_id(used_mask, hello_adv_id_list[a]);
     }
-    // init neighbor entry
-    ret_entry->entry_type = NEIGHBOR_ENTRY;
-    ret_entry->peer_id = new_neighbor_id;
-    ret_entry->link_status = LINK_HEARD;
-    // MUST set link metric as INF at init stage
-    ret_entry->link_metric = 255;
-    ret_entry->in_link_metric = 255;
-    // set neighbor's routing info
-    ret_entry->routing_info.next_hop = 0;
-    ret_entry->routing_info.hop_num = 255;
-    ret_entry->routing_info.path_metric = 255;
-    // register the entry to the entry list
-    entry_ptr_list[new_neighbor_id] = ret_entry;
+    for (int p = peer_num; p >= 1; p--) {
+        if ((used_mask[p / 32] | free_id_mask[p / 32]) & (1u << (p % 32))) continue;
+        free_peer_id(p);
+    }
+}
 
-    ESP_LOGI(TAG, "A new neighbor node entry registered.");
-    return ret_entry;
+// search for the addr in the peer list, do not append it.
+// return the peer_id, or 0 if not in list.
+uint8_t find_peer_id (uint8_t mac_addr[RFC5444_ADDR_LEN]) {
+    return peer_hash_table[find_peer_slot(mac_addr)];
 }
 
-// register a new two-hop struct into the entry_ptr_list, id_list needs to be updated later,
-two_hop_entry_t* register_new_two_hop(uint8_t new_two_hop_id) {
-    if (new_two_hop_id == 0 ) {
-        ESP_LOGW(TAG, "Do not register peer #0!");
-        return NULL;
-    }
-    // must be unregistered
-    assert(entry_ptr_list[new_two_hop_id] == NULL);
-    two_hop_entry_t* ret_entry = calloc(1, sizeof(two_hop_entry_t)); // set to zeros
-    if(ret_entry == NULL) {
-        ESP_LOGE(TAG, "No mem for a new two-hop entry.");
-        return NULL;
+// whether the addr belongs to a neighbor, symmetric or not.
+uint8_t is_neighbor_mac (const uint8_t mac_addr[RFC5444_ADDR_LEN]) {
+    uint8_t peer_id = find_peer_id((uint8_t*)mac_addr);
+    return peer_id != 0 && entry_type_list[peer_id] == NEIGHBOR_ENTRY;
+}
+
+// get the symmetric neighbors which need at least one of the msgs to be forwarded, a msg is not sent back
+// to the neighbor it came from, src_id_list has its peer id for each msg.
+// return the num of ids put in dest_id_list, or max_num + 1 if there are more, then the msgs should be broadcast.
+uint8_t get_fwd_dest_list (uint8_t* src_id_list, uint8_t msg_num, uint8_t* dest_id_list, uint8_t max_num) {
+    uint8_t dest_num = 0;
+    for (int n=0; n < neighbor_id_num; n++) {
+        if (link_status_list[neighbor_id_list[n]] != LINK_SYMMETRIC) continue;
+        uint8_t is_needed = 0;
+        for (int m=0; m < msg_num && !is_needed; m++) {
+            if (src_id_list[m] != neighbor_id_list[n]) is_needed = 1;
+        }
+        if (!is_needed) continue;
+        if (dest_num == max_num) return max_num + 1;
+        dest_id_list[dest_num++] = neighbor_id_list[n];
     }
-    // init two-hop entry
-    ret_entry->entry_type = TWO_HOP_ENTRY;
-    ret_entry->peer_id = new_two_hop_id;
-    // TODO: do we need to assign link status?
-    // MUST set link metric as INF at init stage
-    ret_entry->routing_info.next_hop = 0;
-    ret_entry->routing_info.hop_num = 255;
-    ret_entry->routing_info.path_metric = 255;
-    // register the entry to the entry list
-    entry_ptr_list[new_two_hop_id] = ret_entry;
+    return dest_num;
+}
 
-    ESP_LOGI(TAG, "A new two-hop node entry registered.");
-    return ret_entry;
+// put an entry in the wheel slot of its valid_until.
+static void link_expiry (uint8_t node_id) {
+    uint8_t* head_ptr = &expiry_wheel[valid_until_list[node_id] % EXPIRY_WHEEL_SIZE];
+    expiry_prev_list[node_id] = 0;
+    expiry_next_list[node_id] = *head_ptr;
+    if (*head_ptr != 0) expiry_prev_list[*head_ptr] = node_id;
+    *head_ptr = node_id;
 }
 
-// delete a entry and free the mem. 
-// msut call update_id_lists() after calling this function.
-void delete_entry_by_id (uint8_t node_id) {
-    uint8_t* tmp_entry_ptr = entry_ptr_list[node_id];
-    if (tmp_entry_ptr == NULL ) return;
+static void unlink_expiry (uint8_t node_id) {
+    uint8_t prev_id = expiry_prev_list[node_id];
+    uint8_t next_id = expiry_next_list[node_id];
+    if (prev_id != 0) {
+        expiry_next_list[prev_id] = next_id;
+    } else {
+        expiry_wheel[valid_until_list[node_id] % EXPIRY_WHEEL_SIZE] = next_id;
+    }
+    if (next_id != 0) expiry_prev_list[next_id] = prev_id;
+}
+
+// refresh an entry, it times out after tick #valid_until.
+void set_valid_until (uint8_t node_id, uint32_t valid_until) {
+    assert(entry_type_list[node_id] != NO_ENTRY);
+    if (valid_until % EXPIRY_WHEEL_SIZE == valid_until_list[node_id] % EXPIRY_WHEEL_SIZE) {
+        valid_until_list[node_id] = valid_until;
+        return;
+    }
+    unlink_expiry(node_id);
+    valid_until_list[node_id] = valid_until;
+    link_expiry(node_id);
+}
 
-    switch (tmp_entry_ptr[0]) {
+// the id list of an entry type and a ptr to its num, NULL for NO_ENTRY.
+static uint8_t* get_id_list (uint8_t entry_type, uint8_t** id_num_ptr) {
+    switch (entry_type) {
         case NEIGHBOR_ENTRY: {
-            neighbor_entry_t* neighbor_entry_ptr = (neighbor_entry_t*) tmp_entry_ptr;
-            // it should be fine to free NULL
-            free(neighbor_entry_ptr->link_info.id_list_ptr);
-            free(neighbor_entry_ptr->link_info.metric_list_ptr);
-            free(neighbor_entry_ptr->link_info.in_metric_list_ptr);
-            free(neighbor_entry_ptr);
-            entry_ptr_list[node_id] = NULL;
-            break;
+            *id_num_ptr = &neighbor_id_num;
+            return neighbor_id_list;
         }
         case TWO_HOP_ENTRY: {
-            // leak through to next case
+            *id_num_ptr = &two_hop_id_num;
+            return two_hop_id_list;
         }
         case REMOTE_NODE_ENTRY: {
-            remote_node_entry_t* remote_entry_ptr = (remote_node_entry_t*) tmp_entry_ptr;
-            // it should be fine to free NULL
-            free(remote_entry_ptr->link_info.id_list_ptr);
-            free(remote_entry_ptr->link_info.metric_list_ptr);
-            free(remote_entry_ptr->link_info.in_metric_list_ptr);
-            free(remote_entry_ptr);
-            entry_ptr_list[node_id] = NULL;
-            break;
+            *id_num_ptr = &remote_id_num;
+            return remote_id_list;
         }
         default: {
-            ESP_LOGW(TAG, "Wrong entry type!");
+            return NULL;
         }
     }
 }
 
-// loop over the entry list to count the number of neighbor entries.
-void update_id_lists() {
-    ESP_LOGI(TAG, "Updating id lists ...");
-    neighbor_id_num = 0;
-    two_hop_id_num = 0;
-    remote_id_num = 0;
+#if VERIFY_ID_LISTS
+// every entry is in the id list of its type, at its index.
+static void verify_id_lists () {
+    uint8_t type_num_list[REMOTE_NODE_ENTRY + 1] = {0};
+    uint8_t* id_num_ptr = NULL;
+    for (int p=1; p <= peer_num; p++) {
+        uint8_t* id_list = get_id_list(entry_type_list[p], &id_num_ptr);
+        type_num_list[entry_type_list[p]] ++;
+        if (id_list == NULL) continue;
+        assert(id_list_idx_list[p] < *id_num_ptr && id_list[id_list_idx_list[p]] == p);
+    }
+    assert(type_num_list[NEIGHBOR_ENTRY] == neighbor_id_num);
+    assert(type_num_list[TWO_HOP_ENTRY] == two_hop_id_num);
+    assert(type_num_list[REMOTE_NODE_ENTRY] == remote_id_num);
+}
+#endif
 
-    for(int p=1; p <= peer_num; p++) { // do not use #0
-        if (entry_ptr_list[p] == NULL) {
-            // the entry has been deleted later.
-            continue;
-        }
-        switch ( ((uint8_t*)entry_ptr_list[p])[0] ) {
-            case NEIGHBOR_ENTRY: {
-                neighbor_id_list[neighbor_id_num++] = p;
-                break;
-            }
-            case TWO_HOP_ENTRY: {
-                two_hop_id_list[two_hop_id_num++] = p;
-                break;
-            }
-            case REMOTE_NODE_ENTRY: {
-                remote_id_list[remote_id_num++] = p;
-                break;
-            }
-            default: {
-                ESP_LOGE(TAG, "Unknown entry type!");
-            }
-        }
+// switch the type of an entry and move it to the id list of the new type.
+// it is appended to the new list, the last id of the old list takes its place.
+static void set_entry_type (uint8_t node_id, entry_type_t entry_type) {
+    uint8_t* id_num_ptr = NULL;
+    uint8_t* id_list = get_id_list(entry_type_list[node_id], &id_num_ptr);
+    if (id_list != NULL) {
+        uint8_t idx = id_list_idx_list[node_id];
+        uint8_t last_id = id_list[--(*id_num_ptr)];
+        id_list[idx] = last_id;
+        id_list_idx_list[last_id] = idx;
     }
-    ESP_LOGI(TAG, "neighbor num = %d, two-hop num = %d, remote num = %d", neighbor_id_num, two_hop_id_num, remote_id_num);
-    return;
+    entry_type_list[node_id] = entry_type;
+    id_list = get_id_list(entry_type, &id_num_ptr);
+    if (id_list != NULL) {
+        id_list_idx_list[node_id] = *id_num_ptr;
+        id_list[(*id_num_ptr)++] = node_id;
+    }
+#if VERIFY_ID_LISTS
+    verify_id_lists();
+#endif
+}
+
+// reset the fields all entry types have, the routing info is unknown.
+// the entry times out at the next tick unless it is refreshed by set_valid_until().
+void init_entry (uint8_t node_id, entry_type_t entry_type) {
+    set_entry_type(node_id, entry_type);
+    valid_until_list[node_id] = global_tick_num;
+    link_expiry(node_id);
+    msg_seq_num_list[node_id] = 0;
+    routing_status_list[node_id] = NOT_ROUTING;
+    memset(&link_info_list[node_id], 0, sizeof(link_info_t));
+    routing_info_list[node_id].next_hop = 0;
+    routing_info_list[node_id].hop_num = 255;
+    routing_info_list[node_id].path_metric = 255;
 }
 
-// loop over all entries and delete invalid entries
-// by comparing global_tick_num and entry->valid_until. 
-// valid_until field should be at the same location for all entries.
-void check_entry_validity() {
-    uint8_t* tmp_entry_ptr = NULL;
+// register a new neighbor into the node table.
+// return 0 if it can not be registered.
+uint8_t register_new_neighbor(uint8_t new_neighbor_id) {
+    if (new_neighbor_id == 0 ) {
+        ESP_LOGW(TAG, "Do not register peer #0!");
+        return 0;
+    }
+    if (neighbor_id_num == MAX_NEIGHBOUR_NUM) {
+        ESP_LOGE(TAG, "No room for a new neighbor.");
+        return 0;
+    }
+    // must be unregistered
+    assert(entry_type_list[new_neighbor_id] == NO_ENTRY);
+    // init neighbor entry
+    init_entry(new_neighbor_id, NEIGHBOR_ENTRY);
+    link_status_list[new_neighbor_id] = LINK_HEARD;
+    flooding_status_list[new_neighbor_id] = NOT_FLOODING;
+    memset(&neighbor_entry_list[new_neighbor_id], 0, sizeof(neighbor_entry_t));
+    // MUST set link metric as INF at init stage
+    neighbor_entry_list[new_neighbor_id].link_metric = 255;
+    neighbor_entry_list[new_neighbor_id].in_link_metric = 255;
+
+    ESP_LOGI(TAG, "A new neighbor node entry registered.");
+    return 1;
+}
+
+// register a new two-hop node into the node table,
+// return 0 if it can not be registered.
+uint8_t register_new_two_hop(uint8_t new_two_hop_id) {
+    if (new_two_hop_id == 0 ) {
+        ESP_LOGW(TAG, "Do not register peer #0!");
+        return 0;
+    }
+    // must be unregistered
+    assert(entry_type_list[new_two_hop_id] == NO_ENTRY);
+    // init two-hop entry
+    // TODO: do we need to assign link status?
+    init_entry(new_two_hop_id, TWO_HOP_ENTRY);
+
+    ESP_LOGI(TAG, "A new two-hop node entry registered.");
+    return 1;
+}
+
+// delete a entry and free its links.
+void delete_entry_by_id (uint8_t node_id) {
+    if (entry_type_list[node_id] == NO_ENTRY) return;
+    unlink_expiry(node_id);
+    free_link_info(node_id);
+    set_entry_type(node_id, NO_ENTRY);
+}
+
+// delete the entries timed out since the last call, an entry valid until tick t times out at tick t + 1.
+// only the wheel slots of the ticks passed are walked. return 1 if some entry is deleted.
+uint8_t check_entry_validity() {
     uint8_t delete_flag = 0;
-    for(int n=1; n <= peer_num; n++) { // do not use #0
-        if(entry_ptr_list[n] == NULL) continue;
-        tmp_entry_ptr = (uint8_t*)entry_ptr_list[n];
-        // check entry type
-        if (tmp_entry_ptr[0] == NEIGHBOR_ENTRY) {
-            neighbor_entry_t* neighbor_entry_ptr = (neighbor_entry_t*)tmp_entry_ptr;
-            // check if valid
-            if(neighbor_entry_ptr->valid_until < global_tick_num) {
+    uint32_t tick = expiry_tick_num;
+    // one round of the wheel covers all entries.
+    if (global_tick_num - tick > EXPIRY_WHEEL_SIZE) tick = global_tick_num - EXPIRY_WHEEL_SIZE;
+    for (; tick < global_tick_num; tick++) {
+        uint8_t n = expiry_wheel[tick % EXPIRY_WHEEL_SIZE];
+        while (n != 0) {
+            uint8_t next_id = expiry_next_list[n];
+            // the others in the slot are due in a later round.
+            if (valid_until_list[n] < global_tick_num) {
                 //delete that entry, also need to free link info.
                 delete_flag = 1;
+                if (entry_type_list[n] == NEIGHBOR_ENTRY) {
+                    ESP_LOGW(TAG, "A neighbor node entry is deleted due to timeout!");
+                } else {
+                    // two-hop and remote are inter-changeable.
+                    ESP_LOGW(TAG, "A two-hop/remote node entry is deleted due to timeout!");
+                }
                 delete_entry_by_id(n);
-                ESP_LOGW(TAG, "A neighbor node entry is deleted due to timeout!");
-            }
-        } 
-        else {
-            // two-hop and remote are inter-changeable.
-            two_hop_entry_t* two_hop_entry_ptr = (two_hop_entry_t*)tmp_entry_ptr;
-            // check if valid
-            if (two_hop_entry_ptr->valid_until < global_tick_num) {
-                delete_flag = 1;
-                delete_entry_by_id(n);
-                ESP_LOGW(TAG, "A two-hop/remote node entry is deleted due to timeout!");
             }
+            n = next_id;
         }
     }
-    // if delete some entry, update the id_lists.
+    expiry_tick_num = global_tick_num;
+    // if delete some entry, free the ids no one refers to.
     if(delete_flag) {
-        update_id_lists();
+        reclaim_peer_ids();
     }
+    return delete_flag;
 }
 
 
@@ -241,6 +473,14 @@ void set_info_base_time (uint32_t tick) {
     global_tick_num = tick;
 }
 
+// whether a msg seq num is newer than the last one from the same originator.
+// seq nums wrap around, compare them as in rfc5444 section 5.1.
+// if the node restarts (seq num 0) or we have not got a msg from it yet, take the msg.
+uint8_t is_fresh_seq_num (uint16_t seq_num, uint16_t last_seq_num) {
+    if (seq_num == 0 || last_seq_num == 0) return 1;
+    return (int16_t)(seq_num - last_seq_num) > 0;
+}
+
 void info_base_init (uint8_t mac[RFC5444_ADDR_LEN]) {
     memcpy(originator_addr, mac, RFC5444_ADDR_LEN);
     ESP_LOGI(TAG, "init done, mac addr =  "MACSTR".", MAC2STR(originator_addr));
@@ -256,180 +496,370 @@ void print_link_info(link_info_t target_link_info) {
     printf("\n");
 }
 
-// print info baesd on id_lists and entry_ptr_list.
+// print info baesd on id_lists and the node table.
 void print_topology_set () {
     ESP_LOGI(TAG, "");
     printf("Start printing topology info.\n");
     uint8_t node_id = 0; // peer equals with node.
     neighbor_entry_t* neighbor_ptr = NULL;
-    two_hop_entry_t* two_hop_ptr = NULL;
-    remote_node_entry_t* remote_ptr = NULL;
+    routing_info_t* routing_ptr = NULL;
     printf("Neighbors :\n");
     for(int n=0; n < neighbor_id_num; n++) {
         node_id = neighbor_id_list[n];
-        assert( ((uint8_t*)entry_ptr_list[node_id])[0] == NEIGHBOR_ENTRY);
-        neighbor_ptr = entry_ptr_list[node_id];
+        assert(entry_type_list[node_id] == NEIGHBOR_ENTRY);
+        neighbor_ptr = &neighbor_entry_list[node_id];
         printf("\tNode id = #%d: "MACSTR", link_status = %d, routing next_hop = #%d\n",\
-                node_id, MAC2STR(peer_addr_list[node_id]), neighbor_ptr->link_status, neighbor_ptr->routing_info.next_hop);
+                node_id, MAC2STR(peer_addr_list[node_id]), link_status_list[node_id], routing_info_list[node_id].next_hop);
         printf("\tMPR status = (%d, %d), out_metric = %d, in_metric = %d \n",\
-                neighbor_ptr->flooding_status, neighbor_ptr->routing_status, neighbor_ptr->link_metric, neighbor_ptr->in_link_metric);
-        print_link_info(neighbor_ptr->link_info);
+                flooding_status_list[node_id], routing_status_list[node_id], neighbor_ptr->link_metric, neighbor_ptr->in_link_metric);
+        print_link_info(link_info_list[node_id]);
     }
     printf("TWO_HOPs :\n");
     for(int n=0; n < two_hop_id_num; n++) {
         node_id = two_hop_id_list[n];
-        assert( ((uint8_t*)entry_ptr_list[node_id])[0] == TWO_HOP_ENTRY);
+        assert(entry_type_list[node_id] == TWO_HOP_ENTRY);
         printf("\tNode id = #%d: "MACSTR" \n", node_id, MAC2STR(peer_addr_list[node_id]));
-        two_hop_ptr = entry_ptr_list[node_id];
+        routing_ptr = &routing_info_list[node_id];
         printf(" \trouting next hop = #%d, hop_num = %d, path_metric = %d \n",\
-                    two_hop_ptr->routing_info.next_hop, two_hop_ptr->routing_info.hop_num, two_hop_ptr->routing_info.path_metric);
-        print_link_info(two_hop_ptr->link_info);
+                    routing_ptr->next_hop, routing_ptr->hop_num, routing_ptr->path_metric);
+        print_link_info(link_info_list[node_id]);
     }
     printf("REMOTEs: \n");
     for(int n=0; n < remote_id_num; n++) {
         node_id = remote_id_list[n];
-        assert( ((uint8_t*)entry_ptr_list[node_id])[0] == REMOTE_NODE_ENTRY);
+        assert(entry_type_list[node_id] == REMOTE_NODE_ENTRY);
         printf("\tNode id = #%d: "MACSTR" \n", node_id, MAC2STR(peer_addr_list[node_id]));
-        remote_ptr = entry_ptr_list[node_id];
+        routing_ptr = &routing_info_list[node_id];
         printf(" \trouting next hop = #%d, hop_num = %d, path_metric = %d \n",\
-                    remote_ptr->routing_info.next_hop, remote_ptr->routing_info.hop_num, remote_ptr->routing_info.path_metric);
-        print_link_info(remote_ptr->link_info);
+                    routing_ptr->next_hop, routing_ptr->hop_num, routing_ptr->path_metric);
+        print_link_info(link_info_list[node_id]);
     }
+    printf("Edge pool : %d edges in rows with %d links, %d in holes, of %d\n", edge_end - edge_hole_num, edge_link_num, edge_hole_num, MAX_EDGE_NUM);
     printf("Done printing topology info.\n");
     ESP_LOGI(TAG, "");
 }
 
-// parse the link info given a HELLO msg
-void parse_hello_addr_block(neighbor_entry_t* neighbor_entry_ptr, hello_msg_t* hello_msg_ptr, uint32_t hello_valid_until) {
-    // 1. get addr tlv pointers.
-    uint8_t link_num = hello_msg_ptr->addr_block_ptr->addr_num;
-    assert( hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_len == HELLO_ADDR_TLV_NUM );
-    tlv_t* link_status_tlv_ptr = hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[0];
-    assert( link_status_tlv_ptr->tlv_value_len == link_num);
-    tlv_t* link_metric_tlv_ptr = hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[1];
-    assert( link_metric_tlv_ptr->tlv_value_len == link_num * 2); // out metric list + in metric list !
-    tlv_t* mpr_status_tlv_ptr = hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[2];
-    assert( mpr_status_tlv_ptr->tlv_value_len == link_num * 2); // 2 bytes each value, for flooding and routing
-
-    // 2. delete and alloc link info struct
-    if (neighbor_entry_ptr->link_info.link_num != 0) {
-        // delete old values
-        free(neighbor_entry_ptr->link_info.id_list_ptr);
-        free(neighbor_entry_ptr->link_info.metric_list_ptr);
-        free(neighbor_entry_ptr->link_info.in_metric_list_ptr);
-    }
-    neighbor_entry_ptr->link_info.link_num = link_num;
-    neighbor_entry_ptr->link_info.id_list_ptr = calloc(link_num, sizeof(uint8_t));
-    if (neighbor_entry_ptr->link_info.id_list_ptr == NULL) return;
-    neighbor_entry_ptr->link_info.metric_list_ptr = calloc(link_num, sizeof(uint8_t));
-    if (neighbor_entry_ptr->link_info.metric_list_ptr == NULL) {
-        free(neighbor_entry_ptr->link_info.id_list_ptr);
+// get an empty link info to put the new links of a node in, return 1 if link_num links fit.
+// only one can be used at a time, the links are copied to the edge pool by store_link_info().
+uint8_t alloc_link_info (link_info_t* link_info_ptr, uint16_t link_num) {
+    if (link_num > UINT8_MAX) return 0;
+    link_info_ptr->link_num = 0;
+    link_info_ptr->link_cap = link_num;
+    link_info_ptr->id_list_ptr = staged_id_list;
+    link_info_ptr->metric_list_ptr = staged_metric_list;
+    link_info_ptr->in_metric_list_ptr = staged_in_metric_list;
+    return 1;
+}
+
+// the row of node #node_id becomes a hole.
+void free_link_info (uint8_t node_id) {
+    link_info_t* row_ptr = &link_info_list[node_id];
+    edge_link_num -= row_ptr->link_num;
+    if (row_ptr->link_cap > 0) {
+        // the last row can be taken back at once.
+        if (row_ptr->id_list_ptr - edge_id_pool + row_ptr->link_cap == edge_end) {
+            edge_end -= row_ptr->link_cap;
+        } else {
+            edge_hole_num += row_ptr->link_cap;
+        }
+    }
+    memset(row_ptr, 0, sizeof(link_info_t));
+}
+
+// move the rows down over the holes, in the order of the pool. each row shrinks to its links.
+static void compact_edge_pool () {
+    int32_t last_start = -1; // the rows before it in the old layout have been moved
+    uint16_t new_end = 0;
+    while (1) {
+        // find the next row to move.
+        uint8_t node_id = 0;
+        int32_t row_start = MAX_EDGE_NUM;
+        for (int p=1; p <= peer_num; p++) {
+            if (link_info_list[p].link_cap == 0) continue;
+            int32_t start = link_info_list[p].id_list_ptr - edge_id_pool;
+            if (start > last_start && start < row_start) {
+                node_id = p;
+                row_start = start;
+            }
+        }
+        if (node_id == 0) break;
+        last_start = row_start;
+        link_info_t* row_ptr = &link_info_list[node_id];
+        if (row_ptr->link_num == 0) {
+            memset(row_ptr, 0, sizeof(link_info_t));
+            continue;
+        }
+        memmove(edge_id_pool + new_end, row_ptr->id_list_ptr, row_ptr->link_num);
+        memmove(edge_metric_pool + new_end, row_ptr->metric_list_ptr, row_ptr->link_num);
+        memmove(edge_in_metric_pool + new_end, row_ptr->in_metric_list_ptr, row_ptr->link_num);
+        row_ptr->id_list_ptr = edge_id_pool + new_end;
+        row_ptr->metric_list_ptr = edge_metric_pool + new_end;
+        row_ptr->in_metric_list_ptr = edge_in_metric_pool + new_end;
+        row_ptr->link_cap = row_ptr->link_num;
+        new_end += row_ptr->link_num;
+    }
+    ESP_LOGI(TAG, "Edge pool compacted, %d -> %d edges.", edge_end, new_end);
+    edge_end = new_end;
+    edge_hole_num = 0;
+}
+
+// copy the links got from alloc_link_info() to the row of node #node_id, in place if they fit in it,
+// so a node with the same num of links does not change the shape of the graph.
+// return 0 if the pool is full, the old links are kept.
+uint8_t store_link_info (uint8_t node_id, link_info_t* link_info_ptr) {
+    link_info_t* row_ptr = &link_info_list[node_id];
+    uint8_t link_num = link_info_ptr->link_num;
+    if (link_num > row_ptr->link_cap) {
+        // a new row, check there is room once the holes and the unused edges of the rows are squeezed out.
+        if (edge_link_num - row_ptr->link_num + link_num > MAX_EDGE_NUM) {
+            ESP_LOGE(TAG, "No room for %d links in the edge pool.", link_num);
+            return 0;
+        }
+        free_link_info(node_id);
+        if (edge_end + link_num > MAX_EDGE_NUM) compact_edge_pool();
+        row_ptr->id_list_ptr = edge_id_pool + edge_end;
+        row_ptr->metric_list_ptr = edge_metric_pool + edge_end;
+        row_ptr->in_metric_list_ptr = edge_in_metric_pool + edge_end;
+        row_ptr->link_cap = link_num;
+        edge_end += link_num;
+    }
+    if (link_num > 0) {
+        memcpy(row_ptr->id_list_ptr, link_info_ptr->id_list_ptr, link_num);
+        memcpy(row_ptr->metric_list_ptr, link_info_ptr->metric_list_ptr, link_num);
+        memcpy(row_ptr->in_metric_list_ptr, link_info_ptr->in_metric_list_ptr, link_num);
+    }
+    edge_link_num += link_num - row_ptr->link_num;
+    row_ptr->link_num = link_num;
+    return 1;
+}
+
+// the HELLO sender has a symmetric link to node #two_hop_id, register or refresh the two-hop entry.
+static void update_two_hop_link (uint8_t two_hop_id, uint32_t hello_valid_until) {
+    if (entry_type_list[two_hop_id] == NO_ENTRY) {
+        // a new two hop entry.
+        if (!register_new_two_hop(two_hop_id)) return;
+        set_valid_until(two_hop_id, hello_valid_until);
         return;
     }
-    neighbor_entry_ptr->link_info.in_metric_list_ptr = calloc(link_num, sizeof(uint8_t));
-    if (neighbor_entry_ptr->link_info.in_metric_list_ptr == NULL) {
-        free(neighbor_entry_ptr->link_info.id_list_ptr);
-        free(neighbor_entry_ptr->link_info.metric_list_ptr);
+    // if this is a remote node entry, it must switch to two-hop.
+    if (entry_type_list[two_hop_id] == REMOTE_NODE_ENTRY) {
+        set_entry_type(two_hop_id, TWO_HOP_ENTRY);
+    }
+    if (entry_type_list[two_hop_id] == TWO_HOP_ENTRY) {
+        // update validity
+        set_valid_until(two_hop_id, hello_valid_until);
+    }
+    // if this is a neighbor node id. do nothing.
+}
+
+// metrics are one byte in the info base, larger ones are taken as INF.
+static inline uint8_t clamp_metric (uint32_t metric) {
+    return metric > 255 ? 255 : metric;
+}
+
+// get the values of the idx-th link of a HELLO, from the packed tlvs or the one byte per value tlvs.
+// the tlv lens are checked against the schema in parse_hello_msg().
+static void get_hello_link_value (msg_view_t* hello_msg_ptr, uint8_t idx, hello_link_value_t* value_ptr) {
+    tlv_block_view_t* tlv_block_ptr = &hello_msg_ptr->addr_tlv_block;
+    uint8_t link_num = hello_msg_ptr->addr_block.addr_num;
+    if (tlv_block_ptr->tlv_by_type[LINK_MPR_STATUS] != NULL) {
+        uint8_t status = *get_addr_tlv_value(tlv_block_ptr, LINK_MPR_STATUS, idx);
+        uint32_t out_metric = 0, in_metric = 0;
+        get_metric_pair(get_addr_tlv_value(tlv_block_ptr, COMP_LINK_METRIC, idx), &out_metric, &in_metric);
+        value_ptr->link_status = UNPACK_LINK_STATUS(status);
+        value_ptr->flooding_status = UNPACK_FLOODING_STATUS(status);
+        value_ptr->routing_status = UNPACK_ROUTING_STATUS(status);
+        value_ptr->link_metric = clamp_metric(out_metric);
+        value_ptr->in_link_metric = clamp_metric(in_metric);
+    } else {
+        value_ptr->link_status = tlv_block_ptr->tlv_by_type[LINK_STATUS]->tlv_value[idx];
+        value_ptr->link_metric = tlv_block_ptr->tlv_by_type[LINK_METRIC]->tlv_value[idx]; // out metric list + in metric list !
+        value_ptr->in_link_metric = tlv_block_ptr->tlv_by_type[LINK_METRIC]->tlv_value[link_num + idx];
+        value_ptr->flooding_status = tlv_block_ptr->tlv_by_type[MPR_STATUS]->tlv_value[idx*2]; // 2 bytes each value, for flooding and routing
+        value_ptr->routing_status = tlv_block_ptr->tlv_by_type[MPR_STATUS]->tlv_value[idx*2+1];
+    }
+}
+
+// parse the link info given a HELLO msg
+// a full HELLO replaces the link info of the neighbor, a part of a split one only replaces the links in its addr range.
+// A delta HELLO only carries the links changed since the neighbor's last full HELLO, other links are kept and refreshed.
+// only links to me and symmetric links to other nodes are stored.
+void parse_hello_addr_block(uint8_t neighbor_id, msg_view_t* hello_msg_ptr, uint32_t hello_valid_until, uint8_t is_delta, uint8_t* range_ptr) {
+    neighbor_entry_t* neighbor_entry_ptr = &neighbor_entry_list[neighbor_id];
+    // 1. addr tlv values are read by get_hello_link_value().
+    uint8_t link_num = hello_msg_ptr->addr_block.addr_num;
+    hello_link_value_t link_value;
+
+    // 2. get the peer ids of the listed addrs, 0 for me or unknown nodes.
+    uint8_t link_addr[RFC5444_ADDR_LEN];
+    uint8_t* link_addr_ptr = link_addr;
+    uint8_t* listed_id_list = arena_alloc(&event_arena, link_num);
+    if (listed_id_list == NULL && link_num > 0) {
+        ESP_LOGE(TAG, "No mem to parse HELLO addr block.");
         return;
     }
-    // copy in metric data, two lists
-    memcpy(neighbor_entry_ptr->link_info.metric_list_ptr, link_metric_tlv_ptr->tlv_value, link_num);
-    memcpy(neighbor_entry_ptr->link_info.in_metric_list_ptr, link_metric_tlv_ptr->tlv_value + link_num, link_num);
+    int16_t me_idx = -1; // index of my addr in the block
+    for(int l=0; l < link_num; l++) {
+        get_addr(&hello_msg_ptr->addr_block, l, link_addr);
+        if (memcmp(link_addr_ptr, originator_addr, RFC5444_ADDR_LEN) == 0) {
+            me_idx = l;
+            listed_id_list[l] = 0;
+        } else {
+            listed_id_list[l] = find_peer_id(link_addr_ptr);
+        }
+    }
 
+    // 3. alloc new link info struct, a delta HELLO keeps the old links not listed in it,
+    // a part of a full HELLO keeps the old links out of its range.
+    uint8_t is_merged = is_delta || range_ptr != NULL;
+    link_info_t old_link_info = link_info_list[neighbor_id];
+    link_info_t new_link_info;
+    if (!alloc_link_info(&new_link_info, link_num + (is_merged ? old_link_info.link_num : 0))) {
+        ESP_LOGE(TAG, "Too many links in a HELLO.");
+        return;
+    }
+    uint8_t is_link_summetric = 0;
+    if (is_merged) {
+        // the link to me is unchanged if not listed, and not in the range of the part.
+        is_link_summetric = (me_idx < 0 && (is_delta || !is_addr_in_part(range_ptr, originator_addr))\
+                            && link_status_list[neighbor_id] == LINK_SYMMETRIC);
+        for(int o=0; o < old_link_info.link_num; o++) {
+            uint8_t old_id = old_link_info.id_list_ptr[o];
+            uint8_t is_listed = (old_id == 0 && me_idx >= 0);
+            for(int l=0; l < link_num && !is_listed; l++) {
+                if (old_id != 0 && listed_id_list[l] == old_id) is_listed = 1;
+            }
+            if (is_listed) continue;
+            // the neighbor has no such link any more if it is in the range but not listed.
+            if (!is_delta && is_addr_in_part(range_ptr, old_id == 0 ? originator_addr : peer_addr_list[old_id])) continue;
+            new_link_info.id_list_ptr[new_link_info.link_num] = old_id;
+            new_link_info.metric_list_ptr[new_link_info.link_num] = old_link_info.metric_list_ptr[o];
+            new_link_info.in_metric_list_ptr[new_link_info.link_num] = old_link_info.in_metric_list_ptr[o];
+            new_link_info.link_num ++;
+            // the neighbor still has this link, refresh it.
+            if (old_id != 0) update_two_hop_link(old_id, hello_valid_until);
+        }
+    }
 
-    // 3. loop over addr block values.
-    uint8_t* link_addr_ptr = NULL;
+    // 4. loop over addr block values.
     uint8_t sender_neighbor_id = 0; // here means the neighbor of the HELLO sender
-    uint8_t is_link_summetric = 0;
+    uint8_t new_l = 0;
     for(int l=0; l < link_num; l++) {
-        link_addr_ptr = hello_msg_ptr->addr_block_ptr->addr_list + l * RFC5444_ADDR_LEN;
-        assert(link_status_tlv_ptr->tlv_value[l] != LINK_LOST);
+        get_hello_link_value(hello_msg_ptr, l, &link_value);
+        // LINK_LOST only shows up in delta HELLOs, the link has been removed above.
+        if (link_value.link_status == LINK_LOST) continue;
+        new_l = new_link_info.link_num;
         // (1) if this link point to me/self_addr
-        if (memcmp(link_addr_ptr, originator_addr, RFC5444_ADDR_LEN) == 0) {
+        if (l == me_idx) {
             // we have a symmetric link
-            neighbor_entry_ptr->link_info.id_list_ptr[l] = 0; // empty or originator.
+            new_link_info.id_list_ptr[new_l] = 0; // originator.
+            new_link_info.metric_list_ptr[new_l] = link_value.link_metric;
+            new_link_info.in_metric_list_ptr[new_l] = link_value.in_link_metric;
+            new_link_info.link_num ++;
             is_link_summetric = 1;
-            neighbor_entry_ptr->link_status = LINK_SYMMETRIC;
+            link_status_list[neighbor_id] = LINK_SYMMETRIC;
             // update neighbor out metric using the neighbor's in metric
-            neighbor_entry_ptr->link_metric = link_metric_tlv_ptr->tlv_value[link_num + l];
+            neighbor_entry_ptr->link_metric = link_value.in_link_metric;
             // TODO: define a reasonable in link metric
             neighbor_entry_ptr->in_link_metric = 1;
             // update routing info since we have a symmetric link now.
-            neighbor_entry_ptr->routing_info.next_hop = neighbor_entry_ptr->peer_id;
-            neighbor_entry_ptr->routing_info.hop_num = 1;
-            neighbor_entry_ptr->routing_info.path_metric = neighbor_entry_ptr->link_metric;
+            routing_info_list[neighbor_id].next_hop = neighbor_id;
+            routing_info_list[neighbor_id].hop_num = 1;
+            routing_info_list[neighbor_id].path_metric = neighbor_entry_ptr->link_metric;
             // update MPR info
             // if this node chooses me as the routing MPR.
-            if (mpr_status_tlv_ptr->tlv_value[l*2] == FLOODING_TO || mpr_status_tlv_ptr->tlv_value[l*2] == FLOODING_TO_FROM) {
+            if (link_value.flooding_status == FLOODING_TO || link_value.flooding_status == FLOODING_TO_FROM) {
                 // it is my MPR selector
-                if (neighbor_entry_ptr->flooding_status == NOT_FLOODING) 
-                    neighbor_entry_ptr->flooding_status = FLOODING_FROM;
-                if (neighbor_entry_ptr->flooding_status == FLOODING_TO) 
-                    neighbor_entry_ptr->flooding_status = FLOODING_TO_FROM;
+                if (flooding_status_list[neighbor_id] == NOT_FLOODING) 
+                    flooding_status_list[neighbor_id] = FLOODING_FROM;
+                if (flooding_status_list[neighbor_id] == FLOODING_TO) 
+                    flooding_status_list[neighbor_id] = FLOODING_TO_FROM;
             }
             // if this node chooses me as the routing MPR.
-            if (mpr_status_tlv_ptr->tlv_value[l*2+1] == ROUTING_TO || mpr_status_tlv_ptr->tlv_value[l*2+1] == ROUTING_TO_FROM) {
+            if (link_value.routing_status == ROUTING_TO || link_value.routing_status == ROUTING_TO_FROM) {
                 // it is my MPR selector
-                if (neighbor_entry_ptr->routing_status == NOT_ROUTING) 
-                    neighbor_entry_ptr->routing_status = ROUTING_FROM;
-                if (neighbor_entry_ptr->routing_status == ROUTING_TO) 
-                    neighbor_entry_ptr->routing_status = ROUTING_TO_FROM;
+                if (routing_status_list[neighbor_id] == NOT_ROUTING) 
+                    routing_status_list[neighbor_id] = ROUTING_FROM;
+                if (routing_status_list[neighbor_id] == ROUTING_TO) 
+                    routing_status_list[neighbor_id] = ROUTING_TO_FROM;
             }
         } 
-        else if (link_status_tlv_ptr->tlv_value[l] == LINK_SYMMETRIC) { 
+        else if (link_value.link_status == LINK_SYMMETRIC) { 
             // (2) if is other nodes and link is symmetric (we only add symmetric two hop)
-            // if we have seen this node before.
-            if( get_or_create_id(link_addr_ptr, &sender_neighbor_id) ) {
-                // store this id
-                neighbor_entry_ptr->link_info.id_list_ptr[l] = sender_neighbor_id;
-                uint8_t* tmp_type_ptr = (uint8_t*)(entry_ptr_list[sender_neighbor_id]);
-                two_hop_entry_t* tmp_two_hop_ptr = NULL;
-                // if this is a remote node entry.
-                if (tmp_type_ptr[0] == REMOTE_NODE_ENTRY || tmp_type_ptr[0] == TWO_HOP_ENTRY) {
-                    tmp_type_ptr[0] = TWO_HOP_ENTRY; // entry must switch from remote to two-hop.
-                                                // id_lists will be updated later to keep consistence.
-                    // update validity
-                    tmp_two_hop_ptr = (two_hop_entry_t*) tmp_type_ptr;
-                    tmp_two_hop_ptr->valid_until = hello_valid_until;
-                }
-                // if this is a neighbor node id. do nothing.
-            }
-            else {
-                // a new two hop entry.
-                assert(sender_neighbor_id != 0);
-                neighbor_entry_ptr->link_info.id_list_ptr[l] = sender_neighbor_id;
-                two_hop_entry_t* ret_entry_ptr = register_new_two_hop(sender_neighbor_id);
-                ret_entry_ptr->valid_until = hello_valid_until;
-            }
+            get_addr(&hello_msg_ptr->addr_block, l, link_addr);
+            get_or_create_id(link_addr_ptr, &sender_neighbor_id);
+            if (sender_neighbor_id == 0) continue; // no free id, skip the link.
+            // store this id
+            new_link_info.id_list_ptr[new_l] = sender_neighbor_id;
+            new_link_info.metric_list_ptr[new_l] = link_value.link_metric;
+            new_link_info.in_metric_list_ptr[new_l] = link_value.in_link_metric;
+            new_link_info.link_num ++;
+            update_two_hop_link(sender_neighbor_id, hello_valid_until);
         }
     }
     // update if not symmetric link
     if (is_link_summetric == 0) {
-        neighbor_entry_ptr->link_status = LINK_HEARD;
+        link_status_list[neighbor_id] = LINK_HEARD;
         // out metric stays INF
         // TODO: define a reasonable in link metric
         neighbor_entry_ptr->in_link_metric = 1;
     }
 
+    // 5. replace the old link info.
+    store_link_info(neighbor_id, &new_link_info);
+}
+
+// the deltas of a neighbor are based on its last full HELLO, the seq num of the last part if it is split.
+// the parts of a split HELLO have successive seq nums, it is only a base if all parts are got.
+static void update_hello_base (neighbor_entry_t* neighbor_entry_ptr, uint16_t seq_num, uint8_t* range_ptr) {
+    if (range_ptr == NULL) {
+        neighbor_entry_ptr->has_hello_base = 1;
+        neighbor_entry_ptr->hello_base_seq_num = seq_num;
+        return;
+    }
+    if (memcmp(range_ptr, zero_addr, RFC5444_ADDR_LEN) == 0) {
+        // the first part.
+        neighbor_entry_ptr->has_hello_base = 0;
+        neighbor_entry_ptr->hello_base_seq_num = seq_num;
+        return;
+    }
+    if (neighbor_entry_ptr->has_hello_base || seq_num != (uint16_t)(neighbor_entry_ptr->hello_base_seq_num + 1)) {
+        // a part is lost, wait for the next full HELLO.
+        return;
+    }
+    neighbor_entry_ptr->hello_base_seq_num = seq_num;
+    neighbor_entry_ptr->has_hello_base = (memcmp(range_ptr + RFC5444_ADDR_LEN, broadcast_addr, RFC5444_ADDR_LEN) == 0);
 }
 
-void parse_hello_msg (hello_msg_t* hello_msg_ptr) {
+void parse_hello_msg (msg_view_t* hello_msg_ptr) {
     // update info bases based on HELLO
     ESP_LOGI(TAG, "Start to parse HELLO msg.");
     // get msg originator address.
     uint8_t neighbor_id = 0;
+    uint8_t is_registered = 0;
     neighbor_entry_t* hello_neighbor_entry = NULL;
     uint8_t* hello_orig_addr = hello_msg_ptr->header.msg_orig_addr;
+    uint8_t is_delta = hello_msg_ptr->msg_tlv_block.tlv_by_type[HELLO_BASE_SEQ] != NULL;
+    uint8_t is_packed = hello_msg_ptr->addr_tlv_block.tlv_by_type[LINK_MPR_STATUS] != NULL;
+    uint8_t* range_ptr = NULL; // the addr range of a part of a split HELLO
+
+    // 0. check the tlvs before touching the info base.
+    if (!check_tlv_block(&hello_msg_ptr->msg_tlv_block, is_delta ? &hello_delta_msg_tlv_schema : &hello_msg_tlv_schema, 0)\
+        || !get_part_range(&hello_msg_ptr->msg_tlv_block, &range_ptr)\
+        || !check_tlv_block(&hello_msg_ptr->addr_tlv_block, is_packed ? &hello_packed_addr_tlv_schema : &hello_addr_tlv_schema,\
+                            hello_msg_ptr->addr_block.addr_num)) {
+        ESP_LOGW(TAG, "Drop a HELLO msg with bad TLVs.");
+        return;
+    }
 
     // 1. check and update peer_list and entry_list
     if (get_or_create_id(hello_orig_addr, &neighbor_id)) {
         // if this node has already been stored
-        uint8_t* unknown_entry = entry_ptr_list[neighbor_id];
         // check the current entry type
-        switch (unknown_entry[0]) {
+        switch (entry_type_list[neighbor_id]) {
             case NEIGHBOR_ENTRY: {
                 ESP_LOGI(TAG, "Hello msg is from a familiar neighbor node!");
-                hello_neighbor_entry = (neighbor_entry_t*) unknown_entry;
+                is_registered = 1;
                 break;
             }
             case TWO_HOP_ENTRY: {
@@ -439,7 +869,7 @@ void parse_hello_msg (hello_msg_t* hello_msg_ptr) {
                 delete_entry_by_id(neighbor_id);
                 // (2) register new entry
                 ESP_LOGI(TAG, "A new neighbor node is heard! addr = "MACSTR" .", MAC2STR(hello_orig_addr));
-                hello_neighbor_entry = register_new_neighbor(neighbor_id);
+                is_registered = register_new_neighbor(neighbor_id);
                 break;
             }
             case REMOTE_NODE_ENTRY: {
@@ -449,7 +879,7 @@ void parse_hello_msg (hello_msg_t* hello_msg_ptr) {
                 delete_entry_by_id(neighbor_id);
                 // (2) register new entry
                 ESP_LOGI(TAG, "A new neighbor node is heard! addr = "MACSTR" .", MAC2STR(hello_orig_addr));
-                hello_neighbor_entry = register_new_neighbor(neighbor_id);
+                is_registered = register_new_neighbor(neighbor_id);
                 break;
             }
             default: {
@@ -460,222 +890,330 @@ void parse_hello_msg (hello_msg_t* hello_msg_ptr) {
     } else {
         // a new peer node.
         ESP_LOGI(TAG, "A new neighbor node is heard! addr = "MACSTR" .", MAC2STR(hello_orig_addr));
-        hello_neighbor_entry = register_new_neighbor(neighbor_id);
+        is_registered = register_new_neighbor(neighbor_id);
     }
+    // no free id.
+    if (!is_registered) return;
+    hello_neighbor_entry = &neighbor_entry_list[neighbor_id];
     
     // 2. update entry, neighor and two hop entries
-    assert(hello_neighbor_entry->peer_id == neighbor_id);
     // if the node restarts, do not drop the packet.
-    if (hello_msg_ptr->header.msg_seq_num > 0 && hello_msg_ptr->header.msg_seq_num <= hello_neighbor_entry->msg_seq_num) {
+    if (!is_fresh_seq_num(hello_msg_ptr->header.msg_seq_num, msg_seq_num_list[neighbor_id])) {
         ESP_LOGW(TAG, "Got an out-dated packet, drop it.");
-        // update id_lists, to keep them correct
-        update_id_lists();
         return;
     }
     // update seq_num
-    hello_neighbor_entry->msg_seq_num = hello_msg_ptr->header.msg_seq_num;
+    msg_seq_num_list[neighbor_id] = hello_msg_ptr->header.msg_seq_num;
     // TODO: how to assign link metric ?? This is reduntant, but not a big issue.
     hello_neighbor_entry->in_link_metric = 1; // default metric -> 1 hop cost.
-    uint8_t* tmp_value_ptr = NULL;
-    assert( get_tlv_value(hello_msg_ptr->msg_tlv_block_ptr, IS_MPR_WILLING, &tmp_value_ptr) == 1 );
-    hello_neighbor_entry->is_mpr_willing = *tmp_value_ptr;
-    assert( get_tlv_value(hello_msg_ptr->msg_tlv_block_ptr, VALIDITY_TIME, &tmp_value_ptr) == 1 );
-    hello_neighbor_entry->valid_until =  global_tick_num + *tmp_value_ptr;
+    hello_neighbor_entry->is_mpr_willing = get_tlv_uint(&hello_msg_ptr->msg_tlv_block, MPR_WILLING);
+    set_valid_until(neighbor_id, global_tick_num + get_tlv_uint(&hello_msg_ptr->msg_tlv_block, VALIDITY_TIME));
     
     // update mpr and link info
-    parse_hello_addr_block(hello_neighbor_entry, hello_msg_ptr, hello_neighbor_entry->valid_until);
+    if (is_delta) {
+        // a delta HELLO, only merge it if we have got the full HELLO it is based on.
+        uint16_t base_seq_num = get_tlv_uint(&hello_msg_ptr->msg_tlv_block, HELLO_BASE_SEQ);
+        if (hello_neighbor_entry->has_hello_base && hello_neighbor_entry->hello_base_seq_num == base_seq_num) {
+            parse_hello_addr_block(neighbor_id, hello_msg_ptr, valid_until_list[neighbor_id], 1, NULL);
+        } else {
+            ESP_LOGW(TAG, "Got a delta HELLO without its full HELLO, wait for the next full one.");
+        }
+    } else {
+        parse_hello_addr_block(neighbor_id, hello_msg_ptr, valid_until_list[neighbor_id], 0, range_ptr);
+        update_hello_base(hello_neighbor_entry, hello_msg_ptr->header.msg_seq_num, range_ptr);
+    }
+}
 
-    // update id_lists, to keep them correct
-    update_id_lists();
+// sort peer ids by their mac addrs, so that addrs with the same OUI are put together
+// and can share the head in a compressed addr block.
+void sort_id_list_by_addr (uint8_t* id_list, uint8_t id_num) {
+    uint8_t tmp_id = 0;
+    int j = 0;
+    // insertion sort, the lists are short.
+    for (int i=1; i < id_num; i++) {
+        tmp_id = id_list[i];
+        for (j=i; j > 0 && memcmp(peer_addr_list[id_list[j-1]], peer_addr_list[tmp_id], RFC5444_ADDR_LEN) > 0; j--) {
+            id_list[j] = id_list[j-1];
+        }
+        id_list[j] = tmp_id;
+    }
 }
 
-void gen_hello_msg_tlv (tlv_block_t* msg_tlv_block_ptr) {
-    msg_tlv_block_ptr->tlv_block_type = 0;
-    msg_tlv_block_ptr->tlv_ptr_len = HELLO_MSG_TLV_NUM; // three tlv entries
-    msg_tlv_block_ptr->tlv_block_size = 0;
+// whether the state of the neighbor is different from the one in the last full HELLO.
+static inline uint8_t is_hello_adv_changed (uint8_t neighbor_id) {
+    neighbor_entry_t* neighbor_entry_ptr = &neighbor_entry_list[neighbor_id];
+    hello_adv_t* adv_ptr = &neighbor_entry_ptr->hello_adv;
+    return adv_ptr->is_changed || adv_ptr->link_status != link_status_list[neighbor_id]\
+            || adv_ptr->link_metric != neighbor_entry_ptr->link_metric\
+            || adv_ptr->in_link_metric != neighbor_entry_ptr->in_link_metric\
+            || adv_ptr->flooding_status != flooding_status_list[neighbor_id]\
+            || adv_ptr->routing_status != routing_status_list[neighbor_id];
+}
 
-    // assign tlv entries
-    // 1. VALIDITY_TIME
-    msg_tlv_block_ptr->tlv_ptr_list[0] = malloc(cal_tlv_len(VALIDITY_TIME));
-    if(msg_tlv_block_ptr->tlv_ptr_list[0] == NULL) {
-        ESP_LOGE(TAG, "No mem for tlv block!");
-        free(msg_tlv_block_ptr);
+// the values advertised for a neighbor id, a lost neighbor has no entry any more.
+static void get_hello_adv_value (uint8_t id, hello_link_value_t* value_ptr) {
+    neighbor_entry_t* neighbor_entry_ptr = &neighbor_entry_list[id];
+    if (entry_type_list[id] != NEIGHBOR_ENTRY) {
+        value_ptr->link_status = LINK_LOST;
+        value_ptr->link_metric = 255;
+        value_ptr->in_link_metric = 255;
+        value_ptr->flooding_status = NOT_FLOODING;
+        value_ptr->routing_status = NOT_ROUTING;
         return;
     }
-    msg_tlv_block_ptr->tlv_ptr_list[0]->tlv_type = VALIDITY_TIME;
-    msg_tlv_block_ptr->tlv_ptr_list[0]->tlv_value_len = 1;
-    msg_tlv_block_ptr->tlv_ptr_list[0]->tlv_value[0] = HELLO_VALIDITY_TICKS;
-    msg_tlv_block_ptr->tlv_block_size += cal_tlv_len(VALIDITY_TIME);
-
-    // 2. INTERVAL_TIME
-    msg_tlv_block_ptr->tlv_ptr_list[1] = malloc(cal_tlv_len(INTERVAL_TIME));
-    if(msg_tlv_block_ptr->tlv_ptr_list[1] == NULL) {
-        ESP_LOGE(TAG, "No mem for tlv block!");
-        free(msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(msg_tlv_block_ptr);
-        return;
+    value_ptr->link_status = link_status_list[id];
+    value_ptr->link_metric = neighbor_entry_ptr->link_metric;
+    value_ptr->in_link_metric = neighbor_entry_ptr->in_link_metric;
+    value_ptr->flooding_status = flooding_status_list[id];
+    value_ptr->routing_status = routing_status_list[id];
+}
+
+// whether all the ids have the same out and in metrics, then a packed metric tlv has only one value.
+uint8_t is_single_link_metric (uint8_t* id_list, uint8_t id_num) {
+    hello_link_value_t first_value, tmp_value;
+    if (id_num < 2) return 0;
+    get_hello_adv_value(id_list[0], &first_value);
+    for(int n=1; n < id_num; n++) {
+        get_hello_adv_value(id_list[n], &tmp_value);
+        if (tmp_value.link_metric != first_value.link_metric || tmp_value.in_link_metric != first_value.in_link_metric) {
+            return 0;
+        }
     }
-    msg_tlv_block_ptr->tlv_ptr_list[1]->tlv_type = INTERVAL_TIME;
-    msg_tlv_block_ptr->tlv_ptr_list[1]->tlv_value_len = 1;
-    msg_tlv_block_ptr->tlv_ptr_list[1]->tlv_value[0] = HELLO_INTERVAL_TICKS;
-    msg_tlv_block_ptr->tlv_block_size += cal_tlv_len(INTERVAL_TIME);
-
-    // 3. MPR_WILLING
-    msg_tlv_block_ptr->tlv_ptr_list[2] = malloc(cal_tlv_len(MPR_WILLING));
-    if(msg_tlv_block_ptr->tlv_ptr_list[2] == NULL) {
-        ESP_LOGE(TAG, "No mem for tlv block!");
-        free(msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(msg_tlv_block_ptr->tlv_ptr_list[1]);
-        free(msg_tlv_block_ptr);
-        return;
+    return 1;
+}
+
+// the size of HELLO addr tlv block.
+static uint16_t cal_hello_addr_tlv_block_len (uint8_t* id_list, uint8_t id_num) {
+    if (!PACKED_ADDR_TLV) {
+        return cal_tlv_block_len(&hello_addr_tlv_schema, id_num);
     }
-    msg_tlv_block_ptr->tlv_ptr_list[2]->tlv_type = MPR_WILLING;
-    msg_tlv_block_ptr->tlv_ptr_list[2]->tlv_value_len = 1;
-    msg_tlv_block_ptr->tlv_ptr_list[2]->tlv_value[0] = IS_MPR_WILLING;
-    msg_tlv_block_ptr->tlv_block_size += cal_tlv_len(MPR_WILLING);
+    uint8_t metric_num = is_single_link_metric(id_list, id_num) ? 1 : id_num;
+    return cal_tlv_block_len(&hello_packed_addr_tlv_schema, id_num)\
+            - cal_addr_tlv_len(COMP_LINK_METRIC, id_num) + cal_addr_tlv_len(COMP_LINK_METRIC, metric_num);
+}
 
-    return;
+// write the HELLO addr tlv block, in the order of the schema.
+static void gen_hello_addr_tlv (pkt_writer_t* writer_ptr, uint8_t* id_list, uint8_t id_num) {
+    hello_link_value_t value;
+    if (PACKED_ADDR_TLV) {
+        uint8_t metric_num = is_single_link_metric(id_list, id_num) ? 1 : id_num;
+        gen_tlv_block_header(writer_ptr, hello_packed_addr_tlv_schema.tlv_num,\
+                            cal_hello_addr_tlv_block_len(id_list, id_num) - sizeof(tlv_block_t));
+        // (1) LINK_MPR_STATUS TLV, 1 byte for each neighbor
+        gen_addr_tlv_header(writer_ptr, LINK_MPR_STATUS, id_num);
+        for(int n=0; n < id_num; n++) {
+            get_hello_adv_value(id_list[n], &value);
+            pkt_write_u8(writer_ptr, PACK_LINK_MPR_STATUS(value.link_status, value.flooding_status, value.routing_status));
+        }
+        // (2) COMP_LINK_METRIC TLV, out and in metric of each neighbor, or one pair for all
+        gen_addr_tlv_header(writer_ptr, COMP_LINK_METRIC, metric_num);
+        for(int n=0; n < metric_num; n++) {
+            get_hello_adv_value(id_list[n], &value);
+            gen_metric_pair(writer_ptr, value.link_metric, value.in_link_metric);
+        }
+        return;
+    }
+    gen_tlv_block_header_by_schema(writer_ptr, &hello_addr_tlv_schema, id_num);
+    // (1) LINK_STATUS TLV
+    gen_addr_tlv_header(writer_ptr, LINK_STATUS, id_num);
+    for(int n=0; n < id_num; n++) {
+        get_hello_adv_value(id_list[n], &value);
+        pkt_write_u8(writer_ptr, value.link_status); // assign link status values
+    }
+    // (2) LINK_METRIC TLV, out and in metric lists
+    gen_addr_tlv_header(writer_ptr, LINK_METRIC, id_num);
+    for(int n=0; n < id_num; n++) {
+        get_hello_adv_value(id_list[n], &value);
+        pkt_write_u8(writer_ptr, value.link_metric); // assign out link metric value
+    }
+    for(int n=0; n < id_num; n++) {
+        get_hello_adv_value(id_list[n], &value);
+        pkt_write_u8(writer_ptr, value.in_link_metric); // assign in link metric value
+    }
+    // (3) MPR_STATUS, 2 bytes for each neighbor
+    gen_addr_tlv_header(writer_ptr, MPR_STATUS, id_num);
+    for(int n=0; n < id_num; n++) {
+        // assign MPR status values, both flooding and routing MPR status
+        get_hello_adv_value(id_list[n], &value);
+        pkt_write_u8(writer_ptr, value.flooding_status);
+        pkt_write_u8(writer_ptr, value.routing_status);
+    }
 }
 
-// this function assumes that hello msg has got mem allocated.
-void gen_hello_msg (hello_msg_t* hello_msg_ptr) {
-    assert(hello_msg_ptr != NULL);
+// get the ids to put in the next HELLO, sorted by mac addr. return 1 if it should be a full HELLO.
+// a delta HELLO has the neighbors changed since the last full HELLO and the lost ones.
+static uint8_t get_hello_id_list (uint8_t* id_list, uint8_t* id_num) {
+    neighbor_entry_t* neighbor_entry_ptr = NULL;
+    uint8_t is_full = (hello_delta_num + 1 >= HELLO_FULL_INTERVAL_NUM);
+    // a new neighbor has no full HELLO to merge the deltas into.
+    for(int n=0; n < neighbor_id_num && !is_full; n++) {
+        neighbor_entry_ptr = &neighbor_entry_list[neighbor_id_list[n]];
+        if (!neighbor_entry_ptr->hello_adv.is_advertised) is_full = 1;
+    }
+    *id_num = 0;
+    for(int n=0; n < neighbor_id_num; n++) {
+        if (is_full || is_hello_adv_changed(neighbor_id_list[n])) {
+            id_list[(*id_num)++] = neighbor_id_list[n];
+        }
+    }
+    for(int a=0; a < hello_adv_id_num && !is_full; a++) {
+        if (entry_type_list[hello_adv_id_list[a]] != NEIGHBOR_ENTRY) {
+            id_list[(*id_num)++] = hello_adv_id_list[a];
+        }
+    }
+    sort_id_list_by_addr(id_list, *id_num);
+    return is_full;
+}
 
-    // assign values to the header.
-    msg_header_t* header_ptr = &hello_msg_ptr->header;
-    header_ptr->msg_type = MSG_TYPE_HELLO;
-    header_ptr->msg_flags = 0; // useless currently
-    header_ptr->msg_addr_len = RFC5444_ADDR_LEN - 1; // useless since we only consider MAC addr
-    header_ptr->msg_size = 0; // this needs to be calculated later.
-    memcpy(header_ptr->msg_orig_addr, originator_addr, RFC5444_ADDR_LEN);
-    header_ptr->msg_hop_limit = 1;
-    header_ptr->msg_hop_count = 0;
-    header_ptr->msg_seq_num = global_msg_seq_num++;
-
-    // alloc and set mem for blocks
-    // 1. msg tlv block, validity time and interval time.
-    uint16_t tmp_len = sizeof(tlv_block_t) + HELLO_MSG_TLV_NUM * sizeof(tlv_t*); // three pointers.
-    hello_msg_ptr->msg_tlv_block_ptr = malloc(tmp_len);
-    if(hello_msg_ptr->msg_tlv_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for tlv block!");
-        return;
+// split the ids of a msg into parts, each part takes as many ids as fit in max_part_len bytes,
+// and RFC5444_MAX_ADDR_NUM ids at most, so that its addr tlvs fit.
+// the ids which do not fit in MSG_MAX_PART_NUM parts are dropped, the range of the last part ends before them,
+// see gen_msg_part_range(). part_start_list[part_num] is the end of the ids sent.
+// cal_part_len gives the msg len of the ids [start, end), with PART_ADDR_RANGE if is_split.
+void split_msg_parts (msg_parts_t* parts_ptr, uint16_t max_part_len, uint16_t (*cal_part_len)(msg_parts_t*, uint8_t, uint8_t, uint8_t)) {
+    uint8_t start = 0, end = 0;
+    parts_ptr->part_num = 0;
+    if (parts_ptr->id_num <= RFC5444_MAX_ADDR_NUM && cal_part_len(parts_ptr, 0, parts_ptr->id_num, 0) <= max_part_len) {
+        end = parts_ptr->id_num;
     }
-    gen_hello_msg_tlv(hello_msg_ptr->msg_tlv_block_ptr);
-    header_ptr->msg_size += get_tlv_block_len(hello_msg_ptr->msg_tlv_block_ptr);
-    ESP_LOGI(TAG, "Msg with tlv block, len = %d", header_ptr->msg_size);
-
-    // 2. addr block, put in all neighbors.
-    uint16_t neighbor_num = neighbor_id_num;
-    ESP_LOGI(TAG, "neighbor_num = %d", neighbor_num);
-    tmp_len = sizeof(addr_block_t) + neighbor_num * RFC5444_ADDR_LEN;
-    hello_msg_ptr->addr_block_ptr = malloc(tmp_len);
-    if(hello_msg_ptr->addr_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr block!");
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[1]);
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        return;
+    while (end < parts_ptr->id_num && parts_ptr->part_num < MSG_MAX_PART_NUM) {
+        // at least one id in a part.
+        if (cal_part_len(parts_ptr, start, start + 1, 1) > max_part_len) break;
+        end = start + 1;
+        while (end < parts_ptr->id_num && end - start < RFC5444_MAX_ADDR_NUM\
+               && cal_part_len(parts_ptr, start, end + 1, 1) <= max_part_len) end++;
+        parts_ptr->part_start_list[parts_ptr->part_num++] = start;
+        start = end;
     }
-    hello_msg_ptr->addr_block_ptr->addr_num = neighbor_num;
-    for(int n=0; n < neighbor_num; n++) {
-        memcpy(hello_msg_ptr->addr_block_ptr->addr_list + n * RFC5444_ADDR_LEN,\
-                peer_addr_list[neighbor_id_list[n]], RFC5444_ADDR_LEN);
-    }
-    header_ptr->msg_size += get_addr_block_len(hello_msg_ptr->addr_block_ptr);
-    ESP_LOGI(TAG, "Msg with addr block, len = %d", header_ptr->msg_size);
-
-    // 3. addr tlv block.
-    tmp_len = sizeof(tlv_block_t) + sizeof(tlv_t*) * HELLO_ADDR_TLV_NUM ; // three tlv entry pointers!
-    hello_msg_ptr->addr_tlv_block_ptr = malloc(tmp_len);
-    if(hello_msg_ptr->addr_tlv_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr tlv block!");
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[1]);
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        free(hello_msg_ptr->addr_block_ptr);
-        return;
+    if (end < parts_ptr->id_num) {
+        ESP_LOGW(TAG, "%d ids do not fit in %d msg parts, drop them.", parts_ptr->id_num - end, MSG_MAX_PART_NUM);
     }
-    // generate addr tlv block and all entries
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_block_type = 0;
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_len = HELLO_ADDR_TLV_NUM; // three tlv entry
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_block_size = 0; // to be updated.
-    // (1) LINK_STATUS TLV
-    tmp_len = sizeof(tlv_t) + neighbor_num;
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[0] = malloc(tmp_len);
-    tlv_t* tmp_tlv_ptr = hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[0];
-    if(tmp_tlv_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr tlv 0 entry!");
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[1]);
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        free(hello_msg_ptr->addr_block_ptr);
-        free(hello_msg_ptr->addr_tlv_block_ptr);
-        return;
+    if (parts_ptr->part_num == 0) {
+        parts_ptr->part_start_list[parts_ptr->part_num++] = 0;
     }
-    tmp_tlv_ptr->tlv_type = LINK_STATUS;
-    tmp_tlv_ptr->tlv_value_len = neighbor_num;
-    for(int n=0; n < neighbor_num; n++) {
-        neighbor_entry_t* neighbor_entry_ptr = entry_ptr_list[neighbor_id_list[n]];
-        tmp_tlv_ptr->tlv_value[n] = neighbor_entry_ptr->link_status; // assign link status values
-    }
-    // udpate block size
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_block_size += tmp_len;
-
-    // (2) LINK_METRIC TLV
-    tmp_len = sizeof(tlv_t) + neighbor_num * 2; // out and in metric lists
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[1] = malloc(tmp_len);
-    tmp_tlv_ptr = hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[1];
-    if(tmp_tlv_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr tlv 1 entry!");
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[1]);
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        free(hello_msg_ptr->addr_block_ptr);
-        free(hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->addr_tlv_block_ptr);
-        return;
+    parts_ptr->part_start_list[parts_ptr->part_num] = end;
+}
+
+// write the PART_ADDR_RANGE of a part, from its first addr to the first addr of the next part, or of the dropped ids.
+// the first part starts from the zero addr, the last one ends at the broadcast addr which is no peer's addr.
+void gen_msg_part_range (pkt_writer_t* writer_ptr, msg_parts_t* parts_ptr, uint8_t part_idx) {
+    const uint8_t* lo_addr = zero_addr;
+    const uint8_t* hi_addr = broadcast_addr;
+    if (part_idx > 0) lo_addr = peer_addr_list[parts_ptr->id_list[parts_ptr->part_start_list[part_idx]]];
+    if (parts_ptr->part_start_list[part_idx + 1] < parts_ptr->id_num) hi_addr = peer_addr_list[parts_ptr->id_list[parts_ptr->part_start_list[part_idx + 1]]];
+    gen_part_range_tlv(writer_ptr, lo_addr, hi_addr);
+}
+
+// the num of bytes of a HELLO msg (header included) with the ids [start, end).
+// only the parts of a full HELLO have PART_ADDR_RANGE, delta HELLOs are merged anyway.
+static uint16_t cal_hello_ids_len (msg_parts_t* parts_ptr, uint8_t start, uint8_t end, uint8_t is_split) {
+    return cal_msg_header_len(MSG_FLAGS_HELLO)\
+            + cal_msg_tlv_block_len(parts_ptr->is_full ? &hello_msg_tlv_schema : &hello_delta_msg_tlv_schema, parts_ptr->is_full && is_split)\
+            + cal_addr_block_len(peer_addr_list, parts_ptr->id_list + start, end - start)\
+            + cal_hello_addr_tlv_block_len(parts_ptr->id_list + start, end - start);
+}
+
+// get the ids of the next HELLO and split it into parts of at most max_part_len bytes.
+// return the num of parts, gen_hello_part() must be called for each of them in order.
+uint8_t split_hello_msg (msg_parts_t* parts_ptr, uint16_t max_part_len) {
+    parts_ptr->is_full = get_hello_id_list(parts_ptr->id_list, &parts_ptr->id_num);
+    split_msg_parts(parts_ptr, max_part_len, cal_hello_ids_len);
+    return parts_ptr->part_num;
+}
+
+// the num of bytes of a HELLO part (header included) that gen_hello_part() will write.
+uint16_t cal_hello_part_len (msg_parts_t* parts_ptr, uint8_t part_idx) {
+    return cal_hello_ids_len(parts_ptr, parts_ptr->part_start_list[part_idx], parts_ptr->part_start_list[part_idx + 1], parts_ptr->part_num > 1);
+}
+
+// tlv entries are written in the order of the schema, the range of a part comes last.
+void gen_hello_msg_tlv (pkt_writer_t* writer_ptr, msg_parts_t* parts_ptr, uint8_t part_idx) {
+    uint8_t is_split = parts_ptr->is_full && parts_ptr->part_num > 1;
+    if (parts_ptr->is_full) {
+        gen_msg_tlv_block_header(writer_ptr, &hello_msg_tlv_schema, is_split);
+        HELLO_MSG_TLV_SCHEMA(TLV_SCHEMA_GEN_VALUE)
+    } else {
+        gen_msg_tlv_block_header(writer_ptr, &hello_delta_msg_tlv_schema, 0);
+        HELLO_DELTA_MSG_TLV_SCHEMA(TLV_SCHEMA_GEN_VALUE)
     }
-    tmp_tlv_ptr->tlv_type = LINK_METRIC;
-    tmp_tlv_ptr->tlv_value_len = neighbor_num * 2;
-    for(int n=0; n < neighbor_num; n++) {
-        neighbor_entry_t* neighbor_entry_ptr = entry_ptr_list[neighbor_id_list[n]];
-        tmp_tlv_ptr->tlv_value[n] = neighbor_entry_ptr->link_metric; // assign out link metric value
-        tmp_tlv_ptr->tlv_value[n + neighbor_num] = neighbor_entry_ptr->in_link_metric; // assign in link metric value
-    }
-    // udpate block size
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_block_size += tmp_len;
-
-    // (3) MPR_STATUS
-    tmp_len = sizeof(tlv_t) + neighbor_num * 2; // 2 bytes for each neighbor
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[2] = malloc(tmp_len);
-    tmp_tlv_ptr = hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[2];
-    if(tmp_tlv_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr tlv 2 entry!");
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->msg_tlv_block_ptr->tlv_ptr_list[1]);
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        free(hello_msg_ptr->addr_block_ptr);
-        free(hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[0]);
-        free(hello_msg_ptr->addr_tlv_block_ptr->tlv_ptr_list[1]);
-        free(hello_msg_ptr->addr_tlv_block_ptr);
+    if (is_split) gen_msg_part_range(writer_ptr, parts_ptr, part_idx);
+}
+
+// remember what has been advertised, the following delta HELLOs are based on it.
+// the ids [id_num, all_id_num) are dropped from the msg, see split_msg_parts().
+static void update_hello_adv (uint8_t is_full, uint8_t* id_list, uint8_t id_num, uint8_t all_id_num) {
+    neighbor_entry_t* neighbor_entry_ptr = NULL;
+    if (!is_full) {
+        // once put in a delta, keep it in the deltas, the state may change back later.
+        for(int n=0; n < id_num; n++) {
+            if (entry_type_list[id_list[n]] != NEIGHBOR_ENTRY) continue;
+            neighbor_entry_list[id_list[n]].hello_adv.is_changed = 1;
+        }
+        hello_delta_num ++;
         return;
     }
-    tmp_tlv_ptr->tlv_type = MPR_STATUS;
-    tmp_tlv_ptr->tlv_value_len = neighbor_num * 2;
-    for(int n=0; n < neighbor_num; n++) {
-        neighbor_entry_t* neighbor_entry_ptr = entry_ptr_list[neighbor_id_list[n]];
-        // assign MPR status values, both flooding and routing MPR status
-        tmp_tlv_ptr->tlv_value[n*2] = neighbor_entry_ptr->flooding_status;
-        tmp_tlv_ptr->tlv_value[n*2 + 1] = neighbor_entry_ptr->routing_status;
+    uint8_t neighbor_id = 0;
+    for(int n=0; n < neighbor_id_num; n++) {
+        neighbor_id = neighbor_id_list[n];
+        neighbor_entry_ptr = &neighbor_entry_list[neighbor_id];
+        neighbor_entry_ptr->hello_adv.is_advertised = 1;
+        neighbor_entry_ptr->hello_adv.is_changed = 0;
+        neighbor_entry_ptr->hello_adv.link_status = link_status_list[neighbor_id];
+        neighbor_entry_ptr->hello_adv.link_metric = neighbor_entry_ptr->link_metric;
+        neighbor_entry_ptr->hello_adv.in_link_metric = neighbor_entry_ptr->in_link_metric;
+        neighbor_entry_ptr->hello_adv.flooding_status = flooding_status_list[neighbor_id];
+        neighbor_entry_ptr->hello_adv.routing_status = routing_status_list[neighbor_id];
     }
-    // udpate block size
-    hello_msg_ptr->addr_tlv_block_ptr->tlv_block_size += tmp_len;
-   
-    // update msg size given the addr tlv block
-    header_ptr->msg_size += get_tlv_block_len(hello_msg_ptr->addr_tlv_block_ptr);
+    // the dropped neighbors are not advertised, so the next HELLO is full again.
+    for(int n=id_num; n < all_id_num; n++) {
+        neighbor_entry_list[id_list[n]].hello_adv.is_advertised = 0;
+    }
+    memcpy(hello_adv_id_list, neighbor_id_list, neighbor_id_num);
+    hello_adv_id_num = neighbor_id_num;
+    hello_delta_num = 0;
+}
 
-    // calculate msg len!
-    ESP_LOGI(TAG, "A new HELLO with len = %d", header_ptr->msg_size);
+// write a part of the HELLO msg split by split_hello_msg() straight from the info base into the packet buffer.
+// the buffer must have cal_hello_part_len() bytes left.
+void gen_hello_part (pkt_writer_t* writer_ptr, msg_parts_t* parts_ptr, uint8_t part_idx) {
+    assert(writer_ptr != NULL && part_idx < parts_ptr->part_num);
+    uint16_t start_offset = writer_ptr->offset;
+    // addrs and addr tlvs follow the sorted order.
+    uint8_t* hello_id_list = parts_ptr->id_list + parts_ptr->part_start_list[part_idx];
+    uint8_t hello_id_num = parts_ptr->part_start_list[part_idx + 1] - parts_ptr->part_start_list[part_idx];
+    uint8_t is_full = parts_ptr->is_full;
+
+    // assign values to the header.
+    msg_header_t header;
+    memset(&header, 0, sizeof(msg_header_t));
+    header.msg_type = MSG_TYPE_HELLO;
+    header.msg_flags = MSG_FLAGS_HELLO; // no hop limit and hop count, HELLO is not forwarded
+    header.msg_addr_len = MSG_ADDR_LEN; // useless since we only consider MAC addr
+    header.msg_size = cal_hello_part_len(parts_ptr, part_idx) - cal_msg_header_len(MSG_FLAGS_HELLO);
+    memcpy(header.msg_orig_addr, originator_addr, RFC5444_ADDR_LEN);
+    header.msg_hop_limit = 1;
+    header.msg_hop_count = 0;
+    header.msg_seq_num = global_msg_seq_num++;
+    gen_msg_header(writer_ptr, &header);
+
+    // 1. msg tlv block, validity time and interval time.
+    gen_hello_msg_tlv(writer_ptr, parts_ptr, part_idx);
+
+    // 2. addr block, put in all neighbors, or the changed and lost ones.
+    ESP_LOGI(TAG, "neighbor_num = %d, %s HELLO part %d/%d with %d addrs", neighbor_id_num, is_full ? "full" : "delta",\
+             part_idx + 1, parts_ptr->part_num, hello_id_num);
+    gen_addr_block(writer_ptr, peer_addr_list, hello_id_list, hello_id_num);
+
+    // 3. addr tlv block. a lost neighbor has no entry any more.
+    gen_hello_addr_tlv(writer_ptr, hello_id_list, hello_id_num);
+
+    // check msg len!
+    assert(writer_ptr->offset - start_offset == cal_msg_header_len(MSG_FLAGS_HELLO) + header.msg_size);
+    ESP_LOGI(TAG, "A new HELLO with len = %d", header.msg_size);
+    // the whole HELLO is written with the last part.
+    if (part_idx < parts_ptr->part_num - 1) return;
+    if (is_full) hello_full_seq_num = header.msg_seq_num;
+    update_hello_adv(is_full, parts_ptr->id_list, parts_ptr->part_start_list[parts_ptr->part_num], parts_ptr->id_num);
     // done.
     // ESP_LOGI(TAG, "RAM left %d", esp_get_free_heap_size());
     // ESP_LOGI(TAG, "task stack water mark : %d", uxTaskGetStackHighWaterMark(NULL));
@@ -694,17 +1232,13 @@ void gen_hello_msg (hello_msg_t* hello_msg_ptr) {
 // check whether this node id points to a symmetric two hop node.
 uint8_t is_two_hop_node (uint8_t node_id) {
     // There are a few possibilities.
-    // 1. it is zero, which means emtpy node_id. 2. the entry pointer is NULL, it just got deleted!
+    // 1. it is zero, which means emtpy node_id. 2. the entry type is NO_ENTRY, it just got deleted!
     // 3. the entry is not a two_hop entry. 4. this line must be symmetric (this is already satisfied since we only register symmetric two hop)
-    if( node_id == 0 || entry_ptr_list[node_id] == NULL ) {
-        return 0;
-    }
+    // #0 never has an entry.
     // a special case: an asym neighbor node.
-    if ( ((uint8_t*)entry_ptr_list[node_id])[0] == NEIGHBOR_ENTRY && ((neighbor_entry_t*)entry_ptr_list[node_id])->link_status == LINK_HEARD )
+    if (entry_type_list[node_id] == NEIGHBOR_ENTRY && link_status_list[node_id] == LINK_HEARD)
         return 1;
-    if ( ((uint8_t*)entry_ptr_list[node_id])[0] != TWO_HOP_ENTRY ) 
-        return 0;
-    return 1;
+    return entry_type_list[node_id] == TWO_HOP_ENTRY;
 }
 
 // compute the min metric to get to two-hop nodes
@@ -712,14 +1246,16 @@ uint8_t is_two_hop_node (uint8_t node_id) {
 void compute_min_metric (uint8_t* min_metric_list, uint8_t mpr_flag) {
     uint8_t neighbor_id = 0;
     neighbor_entry_t* neighbor_ptr = NULL;
+    link_info_t* link_info_ptr = NULL;
     uint8_t two_hop_id = 0;
     for (int n=0; n < neighbor_id_num; n++) {
         neighbor_id = neighbor_id_list[n];
-        neighbor_ptr = entry_ptr_list[neighbor_id];
+        neighbor_ptr = &neighbor_entry_list[neighbor_id];
+        link_info_ptr = &link_info_list[neighbor_id];
         // only consider symmetric neighbors
-        if (neighbor_ptr->link_status != LINK_SYMMETRIC) continue;
-        for(int l=0; l < neighbor_ptr->link_info.link_num; l++) {
-            two_hop_id = neighbor_ptr->link_info.id_list_ptr[l];
+        if (link_status_list[neighbor_id] != LINK_SYMMETRIC) continue;
+        for(int l=0; l < link_info_ptr->link_num; l++) {
+            two_hop_id = link_info_ptr->id_list_ptr[l];
             // ESP_LOGW(TAG, "computing min metric, neighbor #%d, has two-hop #%d", neighbor_id, two_hop_id);
             // if this is not a two hop node, skip this one.
             if ( !is_two_hop_node(two_hop_id)) {
@@ -728,10 +1264,10 @@ void compute_min_metric (uint8_t* min_metric_list, uint8_t mpr_flag) {
             // update min
             uint16_t tmp_metric = 0;
             if (mpr_flag == 0) {
-                tmp_metric = neighbor_ptr->link_metric + neighbor_ptr->link_info.metric_list_ptr[l];
+                tmp_metric = neighbor_ptr->link_metric + link_info_ptr->metric_list_ptr[l];
             }
             else {
-                tmp_metric = neighbor_ptr->in_link_metric + neighbor_ptr->link_info.in_metric_list_ptr[l];
+                tmp_metric = neighbor_ptr->in_link_metric + link_info_ptr->in_metric_list_ptr[l];
             }
             if (tmp_metric < min_metric_list[two_hop_id]) {
                 min_metric_list[two_hop_id] = tmp_metric;
@@ -746,12 +1282,13 @@ void update_with_new_mpr (int16_t* mpr_list, uint8_t* metric_list, uint8_t new_m
 #if VERBOSE_MPR
     ESP_LOGI(TAG, "Updating new MPR #%d .", new_mpr_id);
 #endif
-    neighbor_entry_t* neighbor_ptr = entry_ptr_list[new_mpr_id];
-    assert(neighbor_ptr !=  NULL);
-    assert(neighbor_ptr->link_status == LINK_SYMMETRIC);
+    neighbor_entry_t* neighbor_ptr = &neighbor_entry_list[new_mpr_id];
+    link_info_t* link_info_ptr = &link_info_list[new_mpr_id];
+    assert(entry_type_list[new_mpr_id] == NEIGHBOR_ENTRY);
+    assert(link_status_list[new_mpr_id] == LINK_SYMMETRIC);
     uint8_t two_hop_id = 0;
-    for(int l=0; l < neighbor_ptr->link_info.link_num; l++) {
-        two_hop_id = neighbor_ptr->link_info.id_list_ptr[l];
+    for(int l=0; l < link_info_ptr->link_num; l++) {
+        two_hop_id = link_info_ptr->id_list_ptr[l];
         // if this is not a two hop node, skip this one.
         if ( !is_two_hop_node(two_hop_id)) {
             continue;
@@ -759,10 +1296,10 @@ void update_with_new_mpr (int16_t* mpr_list, uint8_t* metric_list, uint8_t new_m
         // update metric list
         uint16_t tmp_metric = 0;
         if (mpr_flag == 0) {
-            tmp_metric = neighbor_ptr->link_metric + neighbor_ptr->link_info.metric_list_ptr[l];
+            tmp_metric = neighbor_ptr->link_metric + link_info_ptr->metric_list_ptr[l];
         }
         else {
-            tmp_metric = neighbor_ptr->in_link_metric + neighbor_ptr->link_info.in_metric_list_ptr[l];
+            tmp_metric = neighbor_ptr->in_link_metric + link_info_ptr->in_metric_list_ptr[l];
         }
         if (metric_list[two_hop_id] > tmp_metric) {
             metric_list[two_hop_id] = tmp_metric;
@@ -776,8 +1313,7 @@ void update_with_new_mpr (int16_t* mpr_list, uint8_t* metric_list, uint8_t new_m
 // if mpr_flag == 0, then flooding MPR; otherwise, routing MPR
 void record_mpr_selection (int16_t* potential_mpr_list, uint8_t* mpr_metric_list, uint8_t mpr_flag) {
     uint8_t neighbor_id = 0;
-    neighbor_entry_t* neighbor_ptr = NULL;
-    two_hop_entry_t* two_hop_ptr = NULL;
+    routing_info_t* two_hop_routing_ptr = NULL;
     if (mpr_flag == 0) { 
         ESP_LOGI(TAG, "Recording Flooding MPR.");
     }
@@ -793,38 +1329,37 @@ void record_mpr_selection (int16_t* potential_mpr_list, uint8_t* mpr_metric_list
         }
         // mark thie neighbor as MPR
         neighbor_id = potential_mpr_list[two_hop_id_list[x]];
-        neighbor_ptr = entry_ptr_list[neighbor_id];
         // update flooding MPR, using out going metric so it gives the routing path as well.
         if (mpr_flag == 0) {
-            if (neighbor_ptr->flooding_status == NOT_FLOODING)
-                neighbor_ptr->flooding_status = FLOODING_TO;
-            if (neighbor_ptr->flooding_status == FLOODING_FROM)
-                neighbor_ptr->flooding_status = FLOODING_TO_FROM;
+            if (flooding_status_list[neighbor_id] == NOT_FLOODING)
+                flooding_status_list[neighbor_id] = FLOODING_TO;
+            if (flooding_status_list[neighbor_id] == FLOODING_FROM)
+                flooding_status_list[neighbor_id] = FLOODING_TO_FROM;
             // record this two-hop node's routing path, this may be reduntant since we compute routing later.
-            two_hop_ptr = entry_ptr_list[two_hop_id_list[x]];
-            two_hop_ptr->routing_info.next_hop = neighbor_id;
-            two_hop_ptr->routing_info.hop_num = 2;
-            two_hop_ptr->routing_info.path_metric = mpr_metric_list[two_hop_id_list[x]];
+            two_hop_routing_ptr = &routing_info_list[two_hop_id_list[x]];
+            two_hop_routing_ptr->next_hop = neighbor_id;
+            two_hop_routing_ptr->hop_num = 2;
+            two_hop_routing_ptr->path_metric = mpr_metric_list[two_hop_id_list[x]];
         }
         // update routing MPR
         else {
-            if (neighbor_ptr->routing_status == NOT_ROUTING)
-                neighbor_ptr->routing_status = ROUTING_TO;
-            if (neighbor_ptr->routing_status == ROUTING_FROM)
-                neighbor_ptr->routing_status = ROUTING_TO_FROM;
+            if (routing_status_list[neighbor_id] == NOT_ROUTING)
+                routing_status_list[neighbor_id] = ROUTING_TO;
+            if (routing_status_list[neighbor_id] == ROUTING_FROM)
+                routing_status_list[neighbor_id] = ROUTING_TO_FROM;
         }
     }
     // there may be asym neighbors
     if (mpr_flag == 0) {
         for (int n=0; n < neighbor_id_num; n++) {
             // if asym link
-            if ( ((neighbor_entry_t*)entry_ptr_list[neighbor_id_list[n]])->link_status == LINK_HEARD ) {
+            if (link_status_list[neighbor_id_list[n]] == LINK_HEARD) {
                 // if there is a path.
                 if (potential_mpr_list[neighbor_id_list[n]] > 0) {
-                    neighbor_entry_t* asym_neighbor_ptr = entry_ptr_list[neighbor_id_list[n]];
-                    asym_neighbor_ptr->routing_info.next_hop = potential_mpr_list[neighbor_id_list[n]];
-                    asym_neighbor_ptr->routing_info.hop_num = 2;
-                    asym_neighbor_ptr->routing_info.path_metric = mpr_metric_list[neighbor_id_list[n]];
+                    routing_info_t* asym_routing_ptr = &routing_info_list[neighbor_id_list[n]];
+                    asym_routing_ptr->next_hop = potential_mpr_list[neighbor_id_list[n]];
+                    asym_routing_ptr->hop_num = 2;
+                    asym_routing_ptr->path_metric = mpr_metric_list[neighbor_id_list[n]];
                 }
             }
         }
@@ -840,10 +1375,11 @@ void update_mpr_status (uint8_t mpr_flag) {
     uint8_t *mpr_metric_list = NULL; // the min metric can be achieved by M
     uint8_t neighbor_id = 0;
     neighbor_entry_t* neighbor_ptr = NULL;
+    link_info_t* link_info_ptr = NULL;
     uint8_t two_hop_id = 0;
 
-    // alloc mem
-    potential_mpr_list = calloc(MAX_PEER_NUM, 4);
+    // alloc mem from the event arena, it is dropped when this event is done.
+    potential_mpr_list = arena_calloc(&event_arena, MAX_PEER_NUM, 4);
     if (potential_mpr_list == NULL) {
         ESP_LOGE(TAG, "Can not alloc mem for lists.");
         return;
@@ -872,11 +1408,12 @@ void update_mpr_status (uint8_t mpr_flag) {
     // 2. For each element y in N for which there is only one element x in N1 such that d2(x,y) is defined, add that element x to M.
     for (int n=0; n < neighbor_id_num; n++) {
         neighbor_id = neighbor_id_list[n];
-        neighbor_ptr = entry_ptr_list[neighbor_id];
+        neighbor_ptr = &neighbor_entry_list[neighbor_id];
+        link_info_ptr = &link_info_list[neighbor_id];
         // only consider symmetric neighbors
-        if (neighbor_ptr->link_status != LINK_SYMMETRIC) continue;
-        for(int l=0; l < neighbor_ptr->link_info.link_num; l++) {
-            two_hop_id = neighbor_ptr->link_info.id_list_ptr[l];
+        if (link_status_list[neighbor_id] != LINK_SYMMETRIC) continue;
+        for(int l=0; l < link_info_ptr->link_num; l++) {
+            two_hop_id = link_info_ptr->id_list_ptr[l];
             // if this is not a two hop node, skip this one.
 #if VERBOSE_MPR
             ESP_LOGI(TAG, "neighbor #%d, has two-hop #%d", neighbor_id, two_hop_id);
@@ -923,14 +1460,15 @@ void update_mpr_status (uint8_t mpr_flag) {
         // loop over N1
         for (int n=0; n < neighbor_id_num; n++) {
             neighbor_id = neighbor_id_list[n];
-            neighbor_ptr = entry_ptr_list[neighbor_id];
+            neighbor_ptr = &neighbor_entry_list[neighbor_id];
+        link_info_ptr = &link_info_list[neighbor_id];
             // only consider symmetric neighbors
-            if (neighbor_ptr->link_status != LINK_SYMMETRIC) continue;
+            if (link_status_list[neighbor_id] != LINK_SYMMETRIC) continue;
             uint8_t tmp_R = 0;
             uint8_t tmp_D = 0;
             // loop over N1 node's coverage
-            for(int l=0; l < neighbor_ptr->link_info.link_num; l++) {
-                two_hop_id = neighbor_ptr->link_info.id_list_ptr[l];
+            for(int l=0; l < link_info_ptr->link_num; l++) {
+                two_hop_id = link_info_ptr->id_list_ptr[l];
                 // if this is not a two hop node, skip this one.
                 if ( !is_two_hop_node(two_hop_id)) {
                     continue;
@@ -938,10 +1476,10 @@ void update_mpr_status (uint8_t mpr_flag) {
                 tmp_D ++; // add the number of covered two hop nodes
                 uint16_t tmp_metric = 0;
                 if (mpr_flag == 0) {
-                    tmp_metric = neighbor_ptr->link_metric + neighbor_ptr->link_info.metric_list_ptr[l];
+                    tmp_metric = neighbor_ptr->link_metric + link_info_ptr->metric_list_ptr[l];
                 }
                 else {
-                    tmp_metric = neighbor_ptr->in_link_metric + neighbor_ptr->link_info.in_metric_list_ptr[l];
+                    tmp_metric = neighbor_ptr->in_link_metric + link_info_ptr->in_metric_list_ptr[l];
                 }
                 // if reaches min metric and smaller than mpr_metric, add R by one. I can cover this one.
                 assert(tmp_metric >= min_metric_list[two_hop_id]);
@@ -973,8 +1511,4 @@ void update_mpr_status (uint8_t mpr_flag) {
 
     // 4. record MPR results
     record_mpr_selection(potential_mpr_list, mpr_metric_list, mpr_flag);
-
-    // FREE mem
-    free(potential_mpr_list);
-    
 }
\ No newline at end of file
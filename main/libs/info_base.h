@@ -14,20 +14,30 @@
 /* Protocol Parameters and Constants */
 #define MAX_PEER_NUM 128
 #define MAX_NEIGHBOUR_NUM 64
+#define PEER_HASH_SIZE (2 * MAX_PEER_NUM)   // slots of the mac addr -> peer_id hash table, a power of 2
+#define MAX_EDGE_NUM (16 * MAX_PEER_NUM)    // links of all nodes in the topology graph
+#define EXPIRY_WHEEL_SIZE 32                // slots of the timing wheel of entry timeouts, one per tick, more than the validity ticks
 
 #define HELLO_VALIDITY_TICKS 15
 #define HELLO_INTERVAL_TICKS 3
+#define HELLO_FULL_INTERVAL_NUM 4   // a full HELLO every N HELLOs, delta HELLOs in between. 1 to disable deltas.
 #define TC_VALIDITY_TICKS 20
 #define TC_INTERVAL_TICKS 5
 
 #define RC_INTERVAL_TICKS 5     // the interval to perform routing path calculation
 
+// the timer fires every slot, msgs are scheduled in slots so that they can be jittered within a tick. see libs/jitter.h
+#define TIMER_SLOTS_PER_TICK    10
+#define HELLO_MAX_JITTER_SLOTS  (HELLO_INTERVAL_TICKS * TIMER_SLOTS_PER_TICK / 4)  // RFC5148 suggests interval / 4
+#define TC_MAX_JITTER_SLOTS     (TC_INTERVAL_TICKS * TIMER_SLOTS_PER_TICK / 4)
+#define FWD_MAX_JITTER_SLOTS    (TIMER_SLOTS_PER_TICK / 2)  // max delay of a msg to be forwarded
+
+#define MSG_MAX_PART_NUM        8   // max num of parts a HELLO or TC msg is split into, the ids which do not fit are dropped.
+
 #define IS_MPR_WILLING       1   // Is current node willing to work as MPR node?
+#define PACKED_ADDR_TLV      1   // send bit-packed status and compressed metric addr tlvs, 0 for one byte per value.
+                                 // both forms are accepted, the tlv types tell them apart.
 
-#define TC_MSG_TLV_NUM    3   // number of TLV entries in msg_tlv_block
-#define TC_ADDR_TLV_NUM    1  // number of TLV entries in addr_tlv_block
-#define HELLO_MSG_TLV_NUM    3   // number of TLV entries in msg_tlv_block
-#define HELLO_ADDR_TLV_NUM    3  // number of TLV entries in addr_tlv_block
 /* Protocol Parameters and Constants End */
 
 #ifndef MAC2STR
@@ -36,11 +46,11 @@
 #endif
 
 /* extern variables to share with routing_set.c */
-extern uint32_t global_msg_seq_num;
+extern uint16_t global_msg_seq_num;
 extern uint32_t global_tick_num; // time counter based on tick
 extern uint8_t peer_num; // 255 should be enough.
 extern uint8_t peer_addr_list[MAX_PEER_NUM][RFC5444_ADDR_LEN]; // use peer_id to get mac address.
-extern void* entry_ptr_list[MAX_PEER_NUM];
+extern uint8_t peer_gen_list[MAX_PEER_NUM]; // bumped when a peer_id is freed
 extern uint8_t neighbor_id_num;
 extern uint8_t neighbor_id_list[MAX_NEIGHBOUR_NUM];
 extern uint8_t two_hop_id_num;
@@ -70,14 +80,23 @@ typedef enum routing_mpr_status_t {
     ROUTING_TO_FROM,
 } routing_mpr_status_t;
 
+// LINK_MPR_STATUS value, <link status:4><flooding MPR status:2><routing MPR status:2>
+#define PACK_LINK_MPR_STATUS(link, flooding, routing)   (((link) << 4) | ((flooding) << 2) | (routing))
+#define UNPACK_LINK_STATUS(value)       ((value) >> 4)
+#define UNPACK_FLOODING_STATUS(value)   (((value) >> 2) & 0x3)
+#define UNPACK_ROUTING_STATUS(value)    ((value) & 0x3)
+
 typedef enum entry_type_t {
+    NO_ENTRY = 0,       // the peer_id is free or only used as a link end
     NEIGHBOR_ENTRY,
     TWO_HOP_ENTRY,
     REMOTE_NODE_ENTRY,
 } entry_type_t;
 
+// the links of a node, a row of the edge pool. see store_link_info()
 typedef struct link_info_t {
     uint8_t link_num;
+    uint8_t link_cap; // edges in the row, link_num of them are used.
     uint8_t* id_list_ptr; // peer id of the other side.
     uint8_t* metric_list_ptr; // this is out going metric.
     uint8_t* in_metric_list_ptr; // in comming link metric ptr list. TODO: this seems useless, may delete it.
@@ -91,54 +110,83 @@ typedef struct routing_info_t {
 
 // TODO: add support for defining gateways.
 
-typedef struct remote_node_entry_t {
-    uint8_t entry_type;
-    uint8_t peer_id;
-    uint32_t msg_seq_num;   // most recent msg seq num , to avoid old packet.
-    uint32_t valid_until;
-    routing_mpr_status_t routing_status;
-    link_info_t link_info;
-    routing_info_t routing_info;
-} remote_node_entry_t;
-
-// Note: two-hop entry and remote entry are inter-changeable.
-typedef struct two_hop_entry_t {
-    uint8_t entry_type;
-    uint8_t peer_id;
-    uint32_t msg_seq_num;   // most recent msg seq num , to avoid old packet.
-    uint32_t valid_until;
-    routing_mpr_status_t routing_status;
-    link_info_t link_info;
-    routing_info_t routing_info;
-}two_hop_entry_t;
+// the link state of a neighbor advertised in the last full HELLO.
+// a delta HELLO carries the neighbors changed since then.
+typedef struct hello_adv_t {
+    uint8_t is_advertised;      // in the last full HELLO
+    uint8_t is_changed;         // has been put in a delta HELLO, keep sending it until the next full HELLO
+    uint8_t link_status;
+    uint8_t link_metric;
+    uint8_t in_link_metric;
+    uint8_t flooding_status;
+    uint8_t routing_status;
+} hello_adv_t;
 
 /* we only consider one interface, so Interface Information Base merges with Neighbor Information Base. */
+// the fields only a neighbor has, the rest are in the node table.
 typedef struct neighbor_entry_t {
-    uint8_t entry_type;
-    uint8_t peer_id; // used to index peer mac addr list.
-    uint32_t msg_seq_num;   // most recent msg seq num , to avoid old packet.
-    uint32_t valid_until;
-    link_status_t link_status;
     uint8_t link_metric;  // out going link metric
     uint8_t in_link_metric; // in comming metric
     uint8_t is_mpr_willing;
-    flooding_mpr_status_t flooding_status;
-    routing_mpr_status_t routing_status;
-    link_info_t link_info;
-    routing_info_t routing_info; // this is needed because there may be asymmetric neighbors.
+    uint8_t has_hello_base;      // got a full HELLO from this neighbor, its delta HELLOs can be merged
+    uint16_t hello_base_seq_num; // msg seq num of that full HELLO
+    hello_adv_t hello_adv;       // what we advertised about this neighbor
 } neighbor_entry_t;
 
+/* the node table, a struct of arrays indexed by peer_id.
+   a node is a neighbor, a two-hop node or a remote node, or has no entry. A node switches type in
+   info_base.c only, which keeps the id lists of each type in step. two-hop and remote nodes only differ in the type.
+   the hot loops sweep the small arrays they need instead of chasing a pointer per node.
+   link_status, flooding_status and the neighbor_entry_list entry only mean something for neighbors,
+   routing_info is also kept for asymmetric neighbors. */
+extern uint8_t entry_type_list[MAX_PEER_NUM];
+extern uint32_t valid_until_list[MAX_PEER_NUM];
+extern uint16_t msg_seq_num_list[MAX_PEER_NUM];     // most recent msg seq num , to avoid old packet.
+extern uint8_t link_status_list[MAX_PEER_NUM];      // link_status_t
+extern uint8_t flooding_status_list[MAX_PEER_NUM];  // flooding_mpr_status_t
+extern uint8_t routing_status_list[MAX_PEER_NUM];   // routing_mpr_status_t
+extern link_info_t link_info_list[MAX_PEER_NUM];
+extern routing_info_t routing_info_list[MAX_PEER_NUM];
+extern neighbor_entry_t neighbor_entry_list[MAX_PEER_NUM];
+
+// a HELLO or TC msg split at addr boundaries, so that each part fits max_part_len bytes. see rfc5444.c
+// a msg that fits is one part without PART_ADDR_RANGE.
+typedef struct msg_parts_t {
+    uint8_t is_full;        // a full HELLO or a delta one, TC msgs are always full.
+    uint8_t id_num;
+    uint8_t id_list[MAX_PEER_NUM]; // the ids in the msg, sorted by mac addr
+    uint8_t part_num;
+    uint8_t part_start_list[MSG_MAX_PART_NUM + 1]; // idx of the first id of each part in id_list, then the end of the ids sent.
+} msg_parts_t;
+
 // TODO: info_base.c should only store and provide helper functions to operate on info bases.
 void info_base_init (uint8_t mac[RFC5444_ADDR_LEN]);
 void set_info_base_time (uint32_t tick);
-void parse_hello_msg (hello_msg_t* hello_msg_ptr);
-void gen_hello_msg (hello_msg_t* hello_msg_ptr);
-uint8_t parse_tc_msg (tc_msg_t* tc_msg_ptr, uint8_t recv_mac[RFC5444_ADDR_LEN]);
-uint8_t gen_tc_msg (tc_msg_t* tc_msg_ptr);
+uint8_t is_fresh_seq_num (uint16_t seq_num, uint16_t last_seq_num);
+void parse_hello_msg (msg_view_t* hello_msg_ptr);
+void sort_id_list_by_addr (uint8_t* id_list, uint8_t id_num);
+uint8_t is_single_link_metric (uint8_t* id_list, uint8_t id_num);
+void split_msg_parts (msg_parts_t* parts_ptr, uint16_t max_part_len, uint16_t (*cal_part_len)(msg_parts_t*, uint8_t, uint8_t, uint8_t));
+void gen_msg_part_range (pkt_writer_t* writer_ptr, msg_parts_t* parts_ptr, uint8_t part_idx);
+uint8_t split_hello_msg (msg_parts_t* parts_ptr, uint16_t max_part_len);
+uint16_t cal_hello_part_len (msg_parts_t* parts_ptr, uint8_t part_idx);
+void gen_hello_part (pkt_writer_t* writer_ptr, msg_parts_t* parts_ptr, uint8_t part_idx);
+uint8_t parse_tc_msg (msg_view_t* tc_msg_ptr, uint8_t recv_mac[RFC5444_ADDR_LEN]);
+uint8_t split_tc_msg (msg_parts_t* parts_ptr, uint16_t max_part_len);
+uint16_t cal_tc_part_len (msg_parts_t* parts_ptr, uint8_t part_idx);
+void gen_tc_part (pkt_writer_t* writer_ptr, msg_parts_t* parts_ptr, uint8_t part_idx);
+uint8_t find_peer_id (uint8_t mac_addr[RFC5444_ADDR_LEN]);
+uint8_t is_neighbor_mac (const uint8_t mac_addr[RFC5444_ADDR_LEN]);
+uint8_t get_fwd_dest_list (uint8_t* src_id_list, uint8_t msg_num, uint8_t* dest_id_list, uint8_t max_num);
+uint8_t alloc_link_info (link_info_t* link_info_ptr, uint16_t link_num);
+uint8_t store_link_info (uint8_t node_id, link_info_t* link_info_ptr);
+void free_link_info (uint8_t node_id);
 uint8_t get_or_create_id (uint8_t mac_addr[RFC5444_ADDR_LEN], uint8_t* peer_id);
+void init_entry (uint8_t node_id, entry_type_t entry_type);
+void set_valid_until (uint8_t node_id, uint32_t valid_until);
 void update_mpr_status (uint8_t mpr_flag);
-void check_entry_validity();
-void update_id_lists();
+uint8_t check_entry_validity();
+void reclaim_peer_ids();
 void compute_routing_set();
 
 #endif
\ No newline at end of file
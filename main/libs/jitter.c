@@ -0,0 +1,35 @@
+#include "esp_system.h"
+#include "jitter.h"
+
+// a random jitter in [0, max_jitter].
+uint32_t jitter_rand (uint32_t max_jitter) {
+    return esp_random() % (max_jitter + 1);
+}
+
+// the timer expires after delay minus a random jitter in [0, max_jitter] slots.
+void jitter_timer_set (jitter_timer_t* timer_ptr, uint32_t now_slot, uint32_t delay, uint32_t max_jitter) {
+    timer_ptr->armed = 1;
+    timer_ptr->due_slot = now_slot + delay - jitter_rand(max_jitter);
+}
+
+void jitter_timer_stop (jitter_timer_t* timer_ptr) {
+    timer_ptr->armed = 0;
+}
+
+uint8_t jitter_timer_expired (jitter_timer_t* timer_ptr, uint32_t now_slot) {
+    return timer_ptr->armed && (int32_t)(now_slot - timer_ptr->due_slot) >= 0;
+}
+
+// whether a periodic msg is due now. called every slot.
+// the first one is due at a random slot in the first interval, then every interval minus a jitter.
+uint8_t jitter_periodic_due (jitter_timer_t* timer_ptr, uint32_t now_slot, uint32_t interval, uint32_t max_jitter) {
+    if (!timer_ptr->armed) {
+        jitter_timer_set(timer_ptr, now_slot, interval, interval - 1);
+        return 0;
+    }
+    if (!jitter_timer_expired(timer_ptr, now_slot)) {
+        return 0;
+    }
+    jitter_timer_set(timer_ptr, now_slot, interval, max_jitter);
+    return 1;
+}
@@ -0,0 +1,23 @@
+/*
+ * jittered timers for msg emission, see RFC5148.
+ * Nodes started together would send their periodic msgs in lockstep and collide, so each interval
+ * is shortened by a random jitter, and msgs to be forwarded wait for a random jitter.
+ * Times are counted in timer slots, see TIMER_SLOTS_PER_TICK.
+ */
+
+#ifndef JITTER_H
+#define JITTER_H
+#include <stdint.h>
+
+typedef struct jitter_timer_t {
+    uint8_t armed;
+    uint32_t due_slot;
+} jitter_timer_t;
+
+uint32_t jitter_rand (uint32_t max_jitter);
+void jitter_timer_set (jitter_timer_t* timer_ptr, uint32_t now_slot, uint32_t delay, uint32_t max_jitter);
+void jitter_timer_stop (jitter_timer_t* timer_ptr);
+uint8_t jitter_timer_expired (jitter_timer_t* timer_ptr, uint32_t now_slot);
+uint8_t jitter_periodic_due (jitter_timer_t* timer_ptr, uint32_t now_slot, uint32_t interval, uint32_t max_jitter);
+
+#endif
@@ -1,146 +1,315 @@
 #include "olsr_handlers.h"
+#include "arena.h"
+#include "jitter.h"
 
 static const char *TAG = "espnow_olsr_handler";
 
+rate_ctrl_t link_rate_ctrl;
+// rate_ctrl has its own copies of these, so that it builds without the info base.
+_Static_assert(RATE_CTRL_ADDR_LEN == RFC5444_ADDR_LEN, "rate_ctrl addr len");
+_Static_assert(RATE_CTRL_LINK_NUM >= MAX_NEIGHBOUR_NUM, "rate_ctrl has a link for each neighbor");
+
+// TC msgs to be forwarded, they wait for a random jitter and are sent together with the local msgs
+// if any is due in the meantime, so that fewer packets are sent than one per forwarded msg.
+#define FWD_MSG_BUF_LEN     (ESPNOW_MAX_PKT_LEN / 2)
+#define FWD_MAX_MSG_NUM     RFC5444_MAX_MSG_NUM
+static uint8_t fwd_msg_buf[FWD_MSG_BUF_LEN];
+static uint16_t fwd_msg_len_list[FWD_MAX_MSG_NUM];
+static uint8_t fwd_src_id_list[FWD_MAX_MSG_NUM];   // peer id of the neighbor each msg came from
+static uint8_t fwd_src_gen_list[FWD_MAX_MSG_NUM];  // generation of that peer id, it may be recycled before the msg is sent
+static uint8_t fwd_msg_num = 0;
+static uint16_t fwd_buf_len = 0;
+
+// msgs are emitted by jittered timers instead of at fixed ticks, so that neighbors do not send in lockstep.
+static jitter_timer_t hello_timer;
+static jitter_timer_t tc_timer;
+static jitter_timer_t fwd_timer;   // armed while there are msgs to be forwarded
+static uint32_t cur_slot_num = 0;
+
+// the local msgs split into parts, see ESPNOW_PKT_PER_FRAME.
+static msg_parts_t hello_parts;
+static msg_parts_t tc_parts;
+
+// a msg to be written into the packets of an event, in the order of the list.
+typedef enum {
+    TX_MSG_HELLO,   // a part of hello_parts
+    TX_MSG_TC,      // a part of tc_parts
+    TX_MSG_FWD,     // the next pending forward msg
+} tx_msg_type_t;
+
+typedef struct tx_msg_t {
+    uint8_t msg_type;
+    uint8_t part_idx;
+    uint16_t msg_len;
+} tx_msg_t;
+#define TX_MAX_MSG_NUM      (2 * MSG_MAX_PART_NUM + FWD_MAX_MSG_NUM)
+
+// the size of the framed tx buffer for a packet of pkt_len bytes and its parity frames.
+static inline uint16_t cal_tx_buf_len (uint16_t pkt_len) {
+    return cal_framed_buf_len(pkt_len, sizeof(espnow_olsr_frame_t), ESPNOW_MAX_PAYLOAD_LEN)\
+            + ESPNOW_PARITY_NUM(ESPNOW_SEG_NUM(pkt_len)) * ESPNOW_MAX_DATA_LEN;
+}
+
+// alloc a framed tx buffer for a broadcast packet of pkt_len bytes, and init the writer on it.
+// the SEND_TO event handling in main event loop will free the buffer.
+// return 0 if no mem.
+static uint8_t alloc_tx_pkt (uint16_t pkt_len, raw_pkt_t* pkt_ptr, pkt_writer_t* writer_ptr) {
+    pkt_ptr->pkt_len = pkt_len;
+    memset(pkt_ptr->mac_addr, 0xff, RFC5444_ADDR_LEN);
+    pkt_ptr->pkt_data = malloc(cal_tx_buf_len(pkt_len));
+    if (pkt_ptr->pkt_data == NULL) {
+        ESP_LOGE(TAG, "No mem for new paket!");
+        return 0;
+    }
+    pkt_writer_init(writer_ptr, pkt_ptr->pkt_data, sizeof(espnow_olsr_frame_t), ESPNOW_MAX_PAYLOAD_LEN);
+    gen_pkt_header(writer_ptr, pkt_len);
+    return 1;
+}
+
+// pop the first num pending forward msgs, they have been written into a packet.
+static void pop_fwd_msgs (uint8_t num, uint16_t len) {
+    memmove(fwd_msg_buf, fwd_msg_buf + len, fwd_buf_len - len);
+    memmove(fwd_msg_len_list, fwd_msg_len_list + num, (fwd_msg_num - num) * sizeof(uint16_t));
+    memmove(fwd_src_id_list, fwd_src_id_list + num, fwd_msg_num - num);
+    memmove(fwd_src_gen_list, fwd_src_gen_list + num, fwd_msg_num - num);
+    fwd_buf_len -= len;
+    fwd_msg_num -= num;
+}
+
+// the last packet of the event has forward msgs only, unicast it to each neighbor which needs them if there are
+// only a few, so that the frames are acked and retried by the MAC layer. otherwise it is broadcast.
+// the packet has the forward msgs [fwd_idx, fwd_idx + msg_num), the copies of the packet are added to the event.
+static void set_fwd_pkt_dest (espnow_olsr_event_t* evt_ptr, uint8_t fwd_idx, uint8_t msg_num) {
+    espnow_olsr_event_send_to_t* send_to_ptr = &evt_ptr->info.send_to;
+    raw_pkt_t* pkt_ptr = &send_to_ptr->pkt_list[send_to_ptr->pkt_num - 1];
+    uint8_t dest_id_list[ESPNOW_UNICAST_MAX_DEST_NUM];
+    uint8_t* src_id_list = fwd_src_id_list + fwd_idx;
+    // a recycled id is some other node now, the msg may be needed by all neighbors.
+    for (int m = 0; m < msg_num; m++) {
+        if (peer_gen_list[src_id_list[m]] != fwd_src_gen_list[fwd_idx + m]) src_id_list[m] = 0;
+    }
+    uint8_t dest_num = get_fwd_dest_list(src_id_list, msg_num, dest_id_list, ESPNOW_UNICAST_MAX_DEST_NUM);
+    // no symmetric neighbor needs them yet, or broadcast is cheaper.
+    if (dest_num == 0 || dest_num > ESPNOW_UNICAST_MAX_DEST_NUM || send_to_ptr->pkt_num + dest_num - 1 > ESPNOW_EVT_MAX_PKT_NUM) {
+        return;
+    }
+    uint16_t buf_len = cal_tx_buf_len(pkt_ptr->pkt_len);
+    for (int d = 1; d < dest_num; d++) {
+        raw_pkt_t* copy_ptr = &send_to_ptr->pkt_list[send_to_ptr->pkt_num - 1 + d];
+        copy_ptr->pkt_len = pkt_ptr->pkt_len;
+        copy_ptr->pkt_data = malloc(buf_len);
+        if (copy_ptr->pkt_data == NULL) {
+            ESP_LOGE(TAG, "No mem to unicast a packet, broadcast it.");
+            for (int c = 1; c < d; c++) free(send_to_ptr->pkt_list[send_to_ptr->pkt_num - 1 + c].pkt_data);
+            return;
+        }
+        memcpy(copy_ptr->pkt_data, pkt_ptr->pkt_data, buf_len);
+    }
+    for (int d = 0; d < dest_num; d++) {
+        memcpy(send_to_ptr->pkt_list[send_to_ptr->pkt_num - 1 + d].mac_addr, peer_addr_list[dest_id_list[d]], RFC5444_ADDR_LEN);
+    }
+    send_to_ptr->pkt_num += dest_num - 1;
+}
+
+// write the msgs into the packets of the SEND_TO event in order, each packet takes as many msgs as fit in
+// ESPNOW_MAX_TX_PKT_LEN bytes, a longer msg has a packet of its own. forward msgs must be at the end of the list,
+// they only start a packet of their own if fwd_own_pkt, otherwise they only fill up the packets of local msgs.
+// the forward msgs written are popped. return the num of msgs written.
+static uint8_t write_tx_msgs (tx_msg_t* msg_list, uint8_t msg_num, uint8_t fwd_own_pkt, espnow_olsr_event_t* evt_ptr) {
+    espnow_olsr_event_send_to_t* send_to_ptr = &evt_ptr->info.send_to;
+    pkt_writer_t pkt_writer;
+    uint8_t m = 0, fwd_num = 0;
+    uint16_t fwd_len = 0;
+    if (evt_ptr->id != ESPNOW_OLSR_SEND_TO) send_to_ptr->pkt_num = 0;
+    while (m < msg_num && send_to_ptr->pkt_num < ESPNOW_EVT_MAX_PKT_NUM) {
+        if (msg_list[m].msg_type == TX_MSG_FWD && !fwd_own_pkt) break;
+        // the msgs [m, end) go in the next packet.
+        uint16_t pkt_len = RFC5444_PKT_HEADER_LEN + msg_list[m].msg_len;
+        uint8_t end = m + 1;
+        while (end < msg_num && end - m < RFC5444_MAX_MSG_NUM && pkt_len + msg_list[end].msg_len <= ESPNOW_MAX_TX_PKT_LEN) {
+            pkt_len += msg_list[end++].msg_len;
+        }
+        if (!alloc_tx_pkt(pkt_len, &send_to_ptr->pkt_list[send_to_ptr->pkt_num], &pkt_writer)) break;
+        uint8_t is_fwd_pkt = (msg_list[m].msg_type == TX_MSG_FWD);
+        uint8_t pkt_fwd_idx = fwd_num;
+        for (; m < end; m++) {
+            switch (msg_list[m].msg_type) {
+                case TX_MSG_HELLO: gen_hello_part(&pkt_writer, &hello_parts, msg_list[m].part_idx); break;
+                case TX_MSG_TC: gen_tc_part(&pkt_writer, &tc_parts, msg_list[m].part_idx); break;
+                default: {
+                    pkt_write(&pkt_writer, fwd_msg_buf + fwd_len, msg_list[m].msg_len);
+                    fwd_len += msg_list[m].msg_len;
+                    fwd_num ++;
+                    break;
+                }
+            }
+        }
+        assert(pkt_writer.offset == pkt_len);
+        send_to_ptr->pkt_num ++;
+        evt_ptr->id = ESPNOW_OLSR_SEND_TO;
+        if (ESPNOW_UNICAST_FWD && is_fwd_pkt) {
+            set_fwd_pkt_dest(evt_ptr, pkt_fwd_idx, fwd_num - pkt_fwd_idx);
+        }
+    }
+    pop_fwd_msgs(fwd_num, fwd_len);
+    return m;
+}
+
+// add the pending forward msgs to the msg list, return the new num of msgs.
+static uint8_t add_fwd_msgs (tx_msg_t* msg_list, uint8_t msg_num) {
+    for (int f = 0; f < fwd_msg_num && msg_num < TX_MAX_MSG_NUM; f++) {
+        msg_list[msg_num].msg_type = TX_MSG_FWD;
+        msg_list[msg_num++].msg_len = fwd_msg_len_list[f];
+    }
+    return msg_num;
+}
+
+// add the parts of a local msg to the msg list, return the new num of msgs.
+static uint8_t add_msg_parts (tx_msg_t* msg_list, uint8_t msg_num, tx_msg_type_t msg_type, uint8_t part_num) {
+    for (int p = 0; p < part_num; p++) {
+        msg_list[msg_num].msg_type = msg_type;
+        msg_list[msg_num].part_idx = p;
+        msg_list[msg_num++].msg_len = (msg_type == TX_MSG_HELLO) ? cal_hello_part_len(&hello_parts, p) : cal_tc_part_len(&tc_parts, p);
+    }
+    return msg_num;
+}
+
+// put the pending forward msgs into packets now, as many as the event can take.
+static void flush_fwd_msgs (espnow_olsr_event_t* evt_ptr) {
+    tx_msg_t msg_list[FWD_MAX_MSG_NUM];
+    write_tx_msgs(msg_list, add_fwd_msgs(msg_list, 0), 1, evt_ptr);
+}
+
 espnow_olsr_event_t olsr_recv_pkt_handler(raw_pkt_t recv_pkt) {
     espnow_olsr_event_t ret_evt;
     ret_evt.id = ESPNOW_OLSR_NO_OP;
-    rfc5444_pkt_t recv_rfc_pkt;
-    // set values to 0x0
-    memset((void*)(&recv_rfc_pkt), 0, sizeof(rfc5444_pkt_t));
+    // the views point into recv_pkt, they only live for this event.
+    rfc5444_pkt_view_t* recv_pkt_view = arena_alloc(&event_arena, sizeof(rfc5444_pkt_view_t));
+    msg_view_t* msg_view = NULL;
     ESP_LOGI(TAG, "Got a packet! len = %d", recv_pkt.pkt_len);
-    
-    // we may need to forward or reply certain msg
-    raw_pkt_t new_raw_pkt;
-    rfc5444_pkt_t new_rfc_pkt;
-    // set values to 0x0
-    memset((void*)(&new_rfc_pkt), 0, sizeof(rfc5444_pkt_t));
-    new_rfc_pkt.pkt_len = RFC5444_PKT_HEADER_LEN;
-    uint8_t tc_forward_flag = 0;
-
-    // parse raw packet
-    recv_rfc_pkt = parse_raw_packet(recv_pkt);
-
-    // 1. handle possible HELLO msg
-    if (recv_rfc_pkt.hello_msg_ptr != NULL) {
-        // update info base given hello msg
-        parse_hello_msg(recv_rfc_pkt.hello_msg_ptr);
-        // only update, no event scheduled.
-    }
-
-    // 2. handle possible TC msg
-    if (recv_rfc_pkt.tc_msg_ptr != NULL) {
-        // update info base given TC msg
-        if(parse_tc_msg(recv_rfc_pkt.tc_msg_ptr, recv_pkt.mac_addr)) {
-            // forward this TC msg, prepare the packet
-            new_rfc_pkt.tc_msg_ptr = malloc(sizeof(tc_msg_t));
-            if (new_rfc_pkt.tc_msg_ptr == NULL) {
-                ESP_LOGE(TAG, "No mem for new TC msg!");
-                free_rfc5444_pkt(recv_rfc_pkt);
-                free_rfc5444_pkt(new_rfc_pkt);
-                return ret_evt;
-            }
-            // borrow the content of recv packet
-            memcpy(new_rfc_pkt.tc_msg_ptr, recv_rfc_pkt.tc_msg_ptr, sizeof(tc_msg_t));
-            // update pkt len
-            new_rfc_pkt.pkt_len += sizeof(msg_header_t) + new_rfc_pkt.tc_msg_ptr->header.msg_size;
-            tc_forward_flag = 1;
-        }
+    if (recv_pkt_view == NULL) {
+        return ret_evt;
     }
 
-    // gen raw pkt and send to event, only if there is msg
-    if(new_rfc_pkt.pkt_len > RFC5444_PKT_HEADER_LEN) {
-        new_raw_pkt = gen_raw_packet(new_rfc_pkt);
-        assert(new_raw_pkt.pkt_data != NULL);
-        ret_evt.id = ESPNOW_OLSR_SEND_TO;
-        ret_evt.info.send_to.pkt = new_raw_pkt;
-        ESP_LOGW(TAG, "A Msg is forwarded!");
+    // parse raw packet
+    if (!parse_raw_packet(recv_pkt, recv_pkt_view, &event_arena)) {
+        ESP_LOGW(TAG, "Drop a malformed packet!");
+        return ret_evt;
     }
 
-    // MUST free all mem
-    free_rfc5444_pkt(recv_rfc_pkt);
-    // we borrowed content form recv_rfc_pkt, but we can not free mem twice.
-    if(tc_forward_flag) {
-        free(new_rfc_pkt.tc_msg_ptr);
-        new_rfc_pkt.tc_msg_ptr = NULL;
+    // handle msgs one by one.
+    for (int m=0; m < recv_pkt_view->msg_num; m++) {
+        msg_view = get_msg_view(recv_pkt_view, m);
+        if (msg_view == NULL) continue;
+        // the seq nums of the msgs a neighbor originates tell how many of them are lost on the link.
+        if (memcmp(msg_view->header.msg_orig_addr, recv_pkt.mac_addr, RFC5444_ADDR_LEN) == 0) {
+            rate_ctrl_on_msg(&link_rate_ctrl, recv_pkt.mac_addr, msg_view->header.msg_seq_num);
+        }
+        switch (msg_view->header.msg_type) {
+            case MSG_TYPE_HELLO: {
+                // update info base given hello msg
+                parse_hello_msg(msg_view);
+                // only update, no event scheduled.
+                break;
+            }
+            case MSG_TYPE_TC: {
+                // update info base given TC msg
+                if (!parse_tc_msg(msg_view, recv_pkt.mac_addr)) break;
+                // forward this TC msg after a jitter with the pending ones,
+                // send the pending ones now if there is no room.
+                if (msg_view->msg_len > FWD_MSG_BUF_LEN) {
+                    ESP_LOGW(TAG, "Msg too long to forward, drop it.");
+                    break;
+                }
+                if (fwd_msg_num == FWD_MAX_MSG_NUM || fwd_buf_len + msg_view->msg_len > FWD_MSG_BUF_LEN) {
+                    flush_fwd_msgs(&ret_evt);
+                }
+                if (fwd_msg_num == FWD_MAX_MSG_NUM || fwd_buf_len + msg_view->msg_len > FWD_MSG_BUF_LEN) {
+                    ESP_LOGW(TAG, "No room to forward a msg, drop it.");
+                    break;
+                }
+                if (fwd_msg_num == 0) {
+                    jitter_timer_set(&fwd_timer, cur_slot_num, FWD_MAX_JITTER_SLOTS, FWD_MAX_JITTER_SLOTS - 1);
+                }
+                // the view header has the updated hop count.
+                pkt_writer_t fwd_writer;
+                pkt_writer_init(&fwd_writer, fwd_msg_buf + fwd_buf_len, 0, 0);
+                gen_forward_msg(&fwd_writer, msg_view);
+                fwd_src_id_list[fwd_msg_num] = find_peer_id(recv_pkt.mac_addr);
+                fwd_src_gen_list[fwd_msg_num] = peer_gen_list[fwd_src_id_list[fwd_msg_num]];
+                fwd_msg_len_list[fwd_msg_num++] = msg_view->msg_len;
+                fwd_buf_len += msg_view->msg_len;
+                ESP_LOGW(TAG, "A Msg is to be forwarded!");
+                break;
+            }
+            default: {
+                break;
+            }
+        }
     }
-    free_rfc5444_pkt(new_rfc_pkt);
 
     return ret_evt;
 }
 
-espnow_olsr_event_t olsr_timer_handler(uint32_t tick_num) {
+// called every timer slot.
+espnow_olsr_event_t olsr_timer_handler(uint32_t slot_num) {
     espnow_olsr_event_t ret_evt;
     ret_evt.id = ESPNOW_OLSR_NO_OP;
-    raw_pkt_t new_raw_pkt;
-    rfc5444_pkt_t new_rfc_pkt;
-    // set values to 0x0
-    memset((void*)(&new_rfc_pkt), 0, sizeof(rfc5444_pkt_t));
-    new_rfc_pkt.pkt_len = RFC5444_PKT_HEADER_LEN;
+    // msg lengths are computed first, so the packets are written in one pass.
+    tx_msg_t msg_list[TX_MAX_MSG_NUM];
+    uint8_t msg_num = 0;
+    // local msgs are split so that each part fits a packet with the packet header.
+    uint16_t max_part_len = ESPNOW_MAX_TX_PKT_LEN - RFC5444_PKT_HEADER_LEN;
+    // a new tick starts, slots may be skipped if the event loop falls behind.
+    uint32_t tick_num = slot_num / TIMER_SLOTS_PER_TICK;
+    uint8_t is_tick = (tick_num != cur_slot_num / TIMER_SLOTS_PER_TICK);
+    uint8_t is_expired = 0;
 
-    ESP_LOGI(TAG, "Time tick #%d is up!", tick_num);
-    set_info_base_time (tick_num);
+    cur_slot_num = slot_num;
+    if (is_tick) {
+        ESP_LOGI(TAG, "Time tick #%d is up!", tick_num);
+        set_info_base_time (tick_num);
+        // delete timeout entries every tick, the routes through a lost node are fixed at once.
+        is_expired = check_entry_validity();
+    }
 
-    // TODO: logic here
-    // 1. send out possible hello msg
-    if (tick_num % HELLO_INTERVAL_TICKS == 0) {
-        // check validity and delete timeout entries
-        check_entry_validity();
+    uint8_t hello_due = jitter_periodic_due(&hello_timer, slot_num, HELLO_INTERVAL_TICKS * TIMER_SLOTS_PER_TICK, HELLO_MAX_JITTER_SLOTS);
+    uint8_t tc_due = jitter_periodic_due(&tc_timer, slot_num, TC_INTERVAL_TICKS * TIMER_SLOTS_PER_TICK, TC_MAX_JITTER_SLOTS);
+    if (hello_due || tc_due) {
         // update flooding and routing MPR
         update_mpr_status(0);
         update_mpr_status(1);
-        // generate and prepare hello msg
-        new_rfc_pkt.hello_msg_ptr = malloc(sizeof(hello_msg_t));
-        if (new_rfc_pkt.hello_msg_ptr == NULL) {
-            ESP_LOGE(TAG, "No mem for new hello msg!");
-            free_rfc5444_pkt(new_rfc_pkt);
-            return ret_evt;
-        }
-        memset(new_rfc_pkt.hello_msg_ptr, 0, sizeof(hello_msg_t));
-        // generate hello msg content
-        gen_hello_msg(new_rfc_pkt.hello_msg_ptr);
-        new_rfc_pkt.pkt_len += sizeof(msg_header_t) + new_rfc_pkt.hello_msg_ptr->header.msg_size;
+    }
+    // 1. send out possible hello msg
+    if (hello_due) {
+        msg_num = add_msg_parts(msg_list, msg_num, TX_MSG_HELLO, split_hello_msg(&hello_parts, max_part_len));
     }
     // 2. send out possible TC msg
-    if (tick_num % TC_INTERVAL_TICKS == 0) {
-        if (tick_num % HELLO_INTERVAL_TICKS != 0) {
-            // check validity and delete timeout entries
-            check_entry_validity();
-            // update flooding and routing MPR
-            update_mpr_status(0);
-            update_mpr_status(1);
-        }
-        // generate and prepare TC msg
-        new_rfc_pkt.tc_msg_ptr = malloc(sizeof(tc_msg_t));
-        if (new_rfc_pkt.tc_msg_ptr == NULL) {
-            ESP_LOGE(TAG, "No mem for new TC msg!");
-            free_rfc5444_pkt(new_rfc_pkt);
-            return ret_evt;
+    if (tc_due) {
+        uint8_t tc_part_num = split_tc_msg(&tc_parts, max_part_len);
+        if (tc_part_num == 0) {
+            ESP_LOGI(TAG, "No routing selector, no TX msg.");
         }
-        memset(new_rfc_pkt.tc_msg_ptr, 0, sizeof(tc_msg_t));
-        // generate tc msg content
-        if( gen_tc_msg(new_rfc_pkt.tc_msg_ptr) ) {
-            new_rfc_pkt.pkt_len += sizeof(msg_header_t) + new_rfc_pkt.tc_msg_ptr->header.msg_size;    
-        } else {
-            free(new_rfc_pkt.tc_msg_ptr);
-            new_rfc_pkt.tc_msg_ptr = NULL;
+        msg_num = add_msg_parts(msg_list, msg_num, TX_MSG_TC, tc_part_num);
+    }
+    // 3. pending forward msgs go out once their jitter is over, or earlier in the packets of local msgs, as many as fit.
+    msg_num = add_fwd_msgs(msg_list, msg_num);
+
+    // gen raw pkts and send to event, only if there is msg
+    write_tx_msgs(msg_list, msg_num, jitter_timer_expired(&fwd_timer, slot_num), &ret_evt);
+    if (ret_evt.id == ESPNOW_OLSR_SEND_TO) {
+        if (fwd_msg_num == 0) {
+            jitter_timer_stop(&fwd_timer);
+        } else if (jitter_timer_expired(&fwd_timer, slot_num)) {
+            // the ones left over go out at the next slot.
+            jitter_timer_set(&fwd_timer, slot_num, 1, 0);
         }
     }
-    // 3. compute routing paths
-    if (tick_num % RC_INTERVAL_TICKS == 0) {
+
+    // 4. compute routing paths
+    if (is_expired || (is_tick && tick_num % RC_INTERVAL_TICKS == 0)) {
         compute_routing_set();
     }
-    
-    // gen raw pkt and send to event, only if there is msg
-    if(new_rfc_pkt.pkt_len > RFC5444_PKT_HEADER_LEN) {
-        new_raw_pkt = gen_raw_packet(new_rfc_pkt);
-        assert(new_raw_pkt.pkt_data != NULL);
-        ret_evt.id = ESPNOW_OLSR_SEND_TO;
-        ret_evt.info.send_to.pkt = new_raw_pkt;
-    }
 
-    // MUST free mem
-    free_rfc5444_pkt(new_rfc_pkt);
     return ret_evt;
 }
-
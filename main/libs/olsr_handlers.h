@@ -2,12 +2,16 @@
 #define OLSR_HANDLERS_H
 
 #include "espnow_olsr.h"
+#include "rate_ctrl.h"
+
+// the rates of the links to neighbors, fed by the msgs heard from them and by the send cbs.
+extern rate_ctrl_t link_rate_ctrl;
 
 /* TODO: do not need to free the pkt. the main event loop will do that */
 // the return event must has a separate buf from the recv_pkt.
 espnow_olsr_event_t olsr_recv_pkt_handler(raw_pkt_t recv_pkt);
 
-espnow_olsr_event_t olsr_timer_handler(uint32_t tick_num);
+espnow_olsr_event_t olsr_timer_handler(uint32_t slot_num);
 
 
 #endif
\ No newline at end of file
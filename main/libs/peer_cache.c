@@ -0,0 +1,76 @@
+#include "esp_wifi.h"
+#include "peer_cache.h"
+
+static const char *TAG = "espnow_peer_cache";
+
+void peer_cache_init (peer_cache_t* cache_ptr) {
+    memset(cache_ptr, 0, sizeof(peer_cache_t));
+}
+
+// delete the idx-th peer from the driver and the cache, the last one takes its place.
+static void del_peer (peer_cache_t* cache_ptr, uint8_t idx) {
+    esp_now_del_peer(cache_ptr->addr_list[idx]);
+    cache_ptr->peer_num --;
+    memcpy(cache_ptr->addr_list[idx], cache_ptr->addr_list[cache_ptr->peer_num], RFC5444_ADDR_LEN);
+    cache_ptr->used_list[idx] = cache_ptr->used_list[cache_ptr->peer_num];
+}
+
+// make sure the peer is added to the driver before a packet is queued to it.
+// the peers is_busy() accepts, e.g. the ones with queued packets, are not evicted.
+// return 0 if there is no room or the driver fails to add it, then the packet should be broadcast.
+uint8_t peer_cache_use (peer_cache_t* cache_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN],\
+                        uint8_t (*is_busy)(const uint8_t mac_addr[RFC5444_ADDR_LEN])) {
+    int lru_idx = -1;
+    cache_ptr->use_count ++;
+    for (int p = 0; p < cache_ptr->peer_num; p++) {
+        if (memcmp(cache_ptr->addr_list[p], mac_addr, RFC5444_ADDR_LEN) == 0) {
+            cache_ptr->used_list[p] = cache_ptr->use_count;
+            return 1;
+        }
+        if (is_busy(cache_ptr->addr_list[p])) continue;
+        if (lru_idx < 0 || cache_ptr->used_list[p] < cache_ptr->used_list[lru_idx]) lru_idx = p;
+    }
+    if (cache_ptr->peer_num == PEER_CACHE_SIZE) {
+        if (lru_idx < 0) {
+            cache_ptr->fail_num ++;
+            return 0;
+        }
+        del_peer(cache_ptr, lru_idx);
+        cache_ptr->evict_num ++;
+    }
+
+    esp_now_peer_info_t peer;
+    memset(&peer, 0, sizeof(esp_now_peer_info_t));
+    peer.channel = CONFIG_ESPNOW_CHANNEL;
+    peer.ifidx = ESPNOW_WIFI_IF;
+    peer.encrypt = false;
+    memcpy(peer.peer_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    esp_err_t err = esp_now_add_peer(&peer);
+    if (err != ESP_OK && err != ESP_ERR_ESPNOW_EXIST) {
+        ESP_LOGW(TAG, "Add peer "MACSTR" error %d.", MAC2STR(mac_addr), err);
+        cache_ptr->fail_num ++;
+        return 0;
+    }
+    memcpy(cache_ptr->addr_list[cache_ptr->peer_num], mac_addr, RFC5444_ADDR_LEN);
+    cache_ptr->used_list[cache_ptr->peer_num] = cache_ptr->use_count;
+    cache_ptr->peer_num ++;
+    return 1;
+}
+
+// delete the peers which is_kept() rejects, e.g. the ones not neighbors any more and without queued packets.
+void peer_cache_prune (peer_cache_t* cache_ptr, uint8_t (*is_kept)(const uint8_t mac_addr[RFC5444_ADDR_LEN])) {
+    int p = 0;
+    while (p < cache_ptr->peer_num) {
+        if (is_kept(cache_ptr->addr_list[p])) {
+            p++;
+            continue;
+        }
+        del_peer(cache_ptr, p);
+    }
+}
+
+void peer_cache_deinit (peer_cache_t* cache_ptr) {
+    while (cache_ptr->peer_num > 0) {
+        del_peer(cache_ptr, cache_ptr->peer_num - 1);
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * an LRU cache of the ESPNOW peers of unicast packets.
+ * The driver only holds about 20 peers, so a peer is added when a packet is queued to it, and the least
+ * recently used one without queued packets is deleted if the cache is full. Peers which are not neighbors
+ * any more are pruned once their queued packets are sent, the caller tells which peers are busy.
+ * A packet is broadcast if its peer can not be added.
+ * The broadcast peer is not in the cache. Only the OLSR task uses the cache.
+ */
+
+#ifndef PEER_CACHE_H
+#define PEER_CACHE_H
+#include "tx_sched.h"
+
+// at least one peer for each queued packet, so that there is a peer to evict unless the queue is full.
+#define PEER_CACHE_SIZE     TX_QUEUE_SIZE
+
+typedef struct peer_cache_t {
+    uint8_t peer_num;
+    uint8_t addr_list[PEER_CACHE_SIZE][RFC5444_ADDR_LEN];
+    uint32_t used_list[PEER_CACHE_SIZE];    // when each peer is used last, in use_count
+    uint32_t use_count;
+    uint32_t evict_num;     // peers deleted since the cache is full
+    uint32_t fail_num;      // peers not added, all busy or the driver fails
+} peer_cache_t;
+
+void peer_cache_init (peer_cache_t* cache_ptr);
+uint8_t peer_cache_use (peer_cache_t* cache_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN],\
+                        uint8_t (*is_busy)(const uint8_t mac_addr[RFC5444_ADDR_LEN]));
+void peer_cache_prune (peer_cache_t* cache_ptr, uint8_t (*is_kept)(const uint8_t mac_addr[RFC5444_ADDR_LEN]));
+void peer_cache_deinit (peer_cache_t* cache_ptr);
+
+#endif
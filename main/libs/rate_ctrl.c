@@ -0,0 +1,126 @@
+#include "rate_ctrl.h"
+
+static const uint8_t broadcast_addr[RATE_CTRL_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+void rate_ctrl_init (rate_ctrl_t* ctrl_ptr) {
+    memset(ctrl_ptr, 0, sizeof(rate_ctrl_t));
+}
+
+static rate_link_t* find_link (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN]) {
+    for (int l = 0; l < ctrl_ptr->link_num; l++) {
+        if (memcmp(ctrl_ptr->link_list[l].mac_addr, mac_addr, RATE_CTRL_ADDR_LEN) == 0) {
+            return &ctrl_ptr->link_list[l];
+        }
+    }
+    return NULL;
+}
+
+static void set_link_rate (rate_link_t* link_ptr, uint8_t rate_idx) {
+    link_ptr->rate_idx = rate_idx;
+    link_ptr->delivery = RATE_CTRL_FULL;
+    link_ptr->sample_num = 0;
+}
+
+// put the send cb of a unicast frame into the EWMA of a link and step its rate if needed.
+static void add_sample (rate_ctrl_t* ctrl_ptr, rate_link_t* link_ptr, uint8_t is_delivered) {
+    int32_t sample = is_delivered ? RATE_CTRL_FULL : 0;
+    link_ptr->delivery += (sample - (int32_t)link_ptr->delivery) >> RATE_CTRL_EWMA_SHIFT;
+    if (link_ptr->sample_num < UINT16_MAX) link_ptr->sample_num ++;
+    if (link_ptr->is_probing && link_ptr->sample_num >= RATE_CTRL_UP_SAMPLES) {
+        link_ptr->is_probing = 0;
+    }
+
+    if (link_ptr->delivery < RATE_CTRL_DOWN_RATIO && link_ptr->sample_num >= RATE_CTRL_MIN_SAMPLES && link_ptr->rate_idx > 0) {
+        // the faster rate just tried does not work, try it less often.
+        if (link_ptr->is_probing) {
+            link_ptr->up_sample_num *= 2;
+            if (link_ptr->up_sample_num > RATE_CTRL_MAX_UP_SAMPLES) link_ptr->up_sample_num = RATE_CTRL_MAX_UP_SAMPLES;
+        } else {
+            link_ptr->up_sample_num = RATE_CTRL_UP_SAMPLES;
+        }
+        link_ptr->is_probing = 0;
+        set_link_rate(link_ptr, link_ptr->rate_idx - 1);
+        ctrl_ptr->down_num ++;
+    } else if (link_ptr->delivery >= RATE_CTRL_UP_RATIO && link_ptr->sample_num >= link_ptr->up_sample_num\
+               && link_ptr->heard >= RATE_CTRL_DOWN_RATIO && link_ptr->rate_idx < RATE_CTRL_RATE_NUM - 1) {
+        link_ptr->is_probing = 1;
+        set_link_rate(link_ptr, link_ptr->rate_idx + 1);
+        ctrl_ptr->up_num ++;
+    }
+}
+
+// put a msg of the neighbor, heard or lost, into the EWMA of the msgs heard from it.
+// it was sent at the neighbor's rate, a poor ratio steps the rate down but a good one never steps it up.
+// return 1 if the rate steps.
+static uint8_t add_heard_sample (rate_ctrl_t* ctrl_ptr, rate_link_t* link_ptr, uint8_t is_heard) {
+    int32_t sample = is_heard ? RATE_CTRL_FULL : 0;
+    link_ptr->heard += (sample - (int32_t)link_ptr->heard) >> RATE_CTRL_EWMA_SHIFT;
+    if (link_ptr->heard_sample_num < UINT16_MAX) link_ptr->heard_sample_num ++;
+
+    if (link_ptr->heard < RATE_CTRL_DOWN_RATIO && link_ptr->heard_sample_num >= RATE_CTRL_MIN_SAMPLES && link_ptr->rate_idx > 0) {
+        link_ptr->is_probing = 0;
+        link_ptr->heard_sample_num = 0;
+        set_link_rate(link_ptr, link_ptr->rate_idx - 1);
+        ctrl_ptr->down_num ++;
+        return 1;
+    }
+    return 0;
+}
+
+// a msg originated by a neighbor is heard straight from it, the msgs in between are lost or never sent.
+// a new neighbor is added here, if there is room.
+void rate_ctrl_on_msg (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN], uint16_t seq_num) {
+    rate_link_t* link_ptr = find_link(ctrl_ptr, mac_addr);
+    if (link_ptr == NULL) {
+        if (ctrl_ptr->link_num == RATE_CTRL_LINK_NUM) return;
+        link_ptr = &ctrl_ptr->link_list[ctrl_ptr->link_num++];
+        memset(link_ptr, 0, sizeof(rate_link_t));
+        memcpy(link_ptr->mac_addr, mac_addr, RATE_CTRL_ADDR_LEN);
+        link_ptr->up_sample_num = RATE_CTRL_UP_SAMPLES;
+        link_ptr->heard = RATE_CTRL_FULL;
+        set_link_rate(link_ptr, RATE_CTRL_INIT_RATE);
+    }
+    int16_t gap = (int16_t)(seq_num - link_ptr->last_seq_num);
+    if (link_ptr->has_seq_num && gap <= 0) return; // an old msg, it has been counted.
+    if (link_ptr->has_seq_num && gap <= RATE_CTRL_MAX_SEQ_GAP) {
+        // one gap steps the rate down once at most.
+        uint8_t is_stepped = 0;
+        for (int g = 1; g < gap && !is_stepped; g++) is_stepped = add_heard_sample(ctrl_ptr, link_ptr, 0);
+        if (!is_stepped) add_heard_sample(ctrl_ptr, link_ptr, 1);
+    }
+    link_ptr->has_seq_num = 1;
+    link_ptr->last_seq_num = seq_num;
+}
+
+// the send cb of a unicast frame to a neighbor, it is acked or all the retries of the MAC layer fail.
+void rate_ctrl_on_tx (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN], uint8_t is_acked) {
+    rate_link_t* link_ptr = find_link(ctrl_ptr, mac_addr);
+    if (link_ptr == NULL) return;
+    add_sample(ctrl_ptr, link_ptr, is_acked);
+}
+
+// the rate of frames to a neighbor, or the lowest rate of all neighbors if it is the broadcast addr.
+uint8_t rate_ctrl_get_rate (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN]) {
+    if (memcmp(mac_addr, broadcast_addr, RATE_CTRL_ADDR_LEN) != 0) {
+        rate_link_t* link_ptr = find_link(ctrl_ptr, mac_addr);
+        return (link_ptr == NULL) ? RATE_CTRL_INIT_RATE : link_ptr->rate_idx;
+    }
+    uint8_t rate_idx = RATE_CTRL_INIT_RATE;
+    for (int l = 0; l < ctrl_ptr->link_num; l++) {
+        if (ctrl_ptr->link_list[l].rate_idx < rate_idx) rate_idx = ctrl_ptr->link_list[l].rate_idx;
+    }
+    return rate_idx;
+}
+
+// delete the links which is_kept() rejects, e.g. the ones not neighbors any more.
+void rate_ctrl_prune (rate_ctrl_t* ctrl_ptr, uint8_t (*is_kept)(const uint8_t mac_addr[RATE_CTRL_ADDR_LEN])) {
+    int l = 0;
+    while (l < ctrl_ptr->link_num) {
+        if (is_kept(ctrl_ptr->link_list[l].mac_addr)) {
+            l++;
+            continue;
+        }
+        ctrl_ptr->link_num --;
+        ctrl_ptr->link_list[l] = ctrl_ptr->link_list[ctrl_ptr->link_num];
+    }
+}
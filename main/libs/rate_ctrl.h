@@ -0,0 +1,60 @@
+/*
+ * per-neighbor PHY rate control from delivery stats.
+ * Each neighbor has a rate on a ladder and the EWMA of the delivery ratio at that rate, from the send cbs of
+ * unicast frames to it, which are acked. The rate steps down if the ratio drops, and steps up after enough
+ * good samples. A step up which fails at once doubles the good samples needed for the next one (AARF).
+ * The msgs the neighbor originates and we hear straight from it are sent at the neighbor's rate, not ours,
+ * and a gap in their seq nums also counts the msgs it never sent, so they can not show that our rate works.
+ * Their delivery ratio is kept apart: a poor one steps the rate down and holds off step ups, a good one
+ * does nothing. A link without unicast traffic never steps up.
+ * Broadcast frames must reach all neighbors, so they use the lowest rate of all.
+ * Rates are ladder indexes, the caller maps them to PHY rates and logs the steps from up_num and down_num,
+ * so this only needs libc and can be tested on a host, see host_test/rate_ctrl.
+ * Only the OLSR task uses it.
+ */
+
+#ifndef RATE_CTRL_H
+#define RATE_CTRL_H
+#include <stdint.h>
+#include <string.h>
+
+#define RATE_CTRL_ADDR_LEN          6                           // mac addr, RFC5444_ADDR_LEN
+#define RATE_CTRL_RATE_NUM          6                           // rates in the ladder, #0 is the most robust one
+#define RATE_CTRL_INIT_RATE         (RATE_CTRL_RATE_NUM - 1)    // a new neighbor starts at the fastest rate
+#define RATE_CTRL_LINK_NUM          64                          // MAX_NEIGHBOUR_NUM
+#define RATE_CTRL_FULL              (1 << 12)                   // the delivery ratio of 1
+#define RATE_CTRL_EWMA_SHIFT        3                           // a new sample weights 1/8
+#define RATE_CTRL_DOWN_RATIO        (RATE_CTRL_FULL * 3 / 4)    // step down below this ratio
+#define RATE_CTRL_UP_RATIO          (RATE_CTRL_FULL * 15 / 16)  // step up above this ratio
+#define RATE_CTRL_MIN_SAMPLES       4                           // samples at a rate before it can step down
+#define RATE_CTRL_UP_SAMPLES        16                          // samples at a rate before it can step up
+#define RATE_CTRL_MAX_UP_SAMPLES    256
+#define RATE_CTRL_MAX_SEQ_GAP       16                          // a larger gap means the neighbor restarted or was away
+
+typedef struct rate_link_t {
+    uint8_t mac_addr[RATE_CTRL_ADDR_LEN];
+    uint8_t rate_idx;
+    uint8_t has_seq_num;
+    uint16_t last_seq_num;      // seq num of the last msg heard from the neighbor
+    uint16_t delivery;          // EWMA of the delivery ratio of unicast frames at rate_idx
+    uint16_t sample_num;        // unicast samples since rate_idx changed
+    uint16_t up_sample_num;     // unicast samples needed to step up
+    uint8_t is_probing;         // rate_idx is stepped up and has not got up_sample_num samples yet
+    uint16_t heard;             // EWMA of the ratio of the neighbor's msgs heard, at its own rate
+    uint16_t heard_sample_num;  // msgs counted since the last step down for them
+} rate_link_t;
+
+typedef struct rate_ctrl_t {
+    uint8_t link_num;
+    rate_link_t link_list[RATE_CTRL_LINK_NUM];
+    uint32_t up_num;        // steps up of all links
+    uint32_t down_num;      // steps down of all links
+} rate_ctrl_t;
+
+void rate_ctrl_init (rate_ctrl_t* ctrl_ptr);
+void rate_ctrl_on_msg (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN], uint16_t seq_num);
+void rate_ctrl_on_tx (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN], uint8_t is_acked);
+uint8_t rate_ctrl_get_rate (rate_ctrl_t* ctrl_ptr, const uint8_t mac_addr[RATE_CTRL_ADDR_LEN]);
+void rate_ctrl_prune (rate_ctrl_t* ctrl_ptr, uint8_t (*is_kept)(const uint8_t mac_addr[RATE_CTRL_ADDR_LEN]));
+
+#endif
@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include "reassembly.h"
+
+static const char *TAG = "espnow_reassembly";
+
+void reasm_init (reasm_table_t* table_ptr) {
+    memset(table_ptr, 0, sizeof(reasm_table_t));
+}
+
+// free the buf of a slot, the slot can be used by a new packet.
+void reasm_free_slot (reasm_table_t* table_ptr, reasm_slot_t* slot_ptr) {
+    if (!slot_ptr->in_use) return;
+    free(slot_ptr->pkt.pkt_data);
+    table_ptr->mem_used -= slot_ptr->pkt.pkt_len;
+    memset(slot_ptr, 0, sizeof(reasm_slot_t));
+}
+
+void reasm_deinit (reasm_table_t* table_ptr) {
+    for (int s=0; s < REASM_SLOT_NUM; s++) {
+        reasm_free_slot(table_ptr, &table_ptr->slot_list[s]);
+    }
+}
+
+// drop a packet that will not be completed.
+static void drop_slot (reasm_table_t* table_ptr, reasm_slot_t* slot_ptr, const char* reason) {
+    ESP_LOGW(TAG, "Drop packet #%d from "MACSTR", %s.", slot_ptr->pkt_id, MAC2STR(slot_ptr->mac_addr), reason);
+    table_ptr->drop_num ++;
+    reasm_free_slot(table_ptr, slot_ptr);
+}
+
+// free the slots timed out, and return a free slot with room for pkt_len bytes.
+// if there is no room, the packets that started first are dropped. return NULL if pkt_len is over the cap.
+static reasm_slot_t* alloc_slot (reasm_table_t* table_ptr, uint16_t pkt_len, uint32_t now_ms) {
+    reasm_slot_t* free_slot_ptr = NULL;
+    reasm_slot_t* oldest_slot_ptr = NULL;
+    if (pkt_len > REASM_MEM_CAP) return NULL;
+    while (1) {
+        free_slot_ptr = NULL;
+        oldest_slot_ptr = NULL;
+        for (int s=0; s < REASM_SLOT_NUM; s++) {
+            reasm_slot_t* slot_ptr = &table_ptr->slot_list[s];
+            if (slot_ptr->in_use && (int32_t)(now_ms - slot_ptr->expire_ms) >= 0) {
+                drop_slot(table_ptr, slot_ptr, "timeout");
+            }
+            if (!slot_ptr->in_use) {
+                if (free_slot_ptr == NULL) free_slot_ptr = slot_ptr;
+            } else if (oldest_slot_ptr == NULL || (int32_t)(slot_ptr->expire_ms - oldest_slot_ptr->expire_ms) < 0) {
+                oldest_slot_ptr = slot_ptr;
+            }
+        }
+        if (free_slot_ptr != NULL && table_ptr->mem_used + pkt_len <= REASM_MEM_CAP) {
+            return free_slot_ptr;
+        }
+        drop_slot(table_ptr, oldest_slot_ptr, "no room");
+    }
+}
+
+// the slot receiving the packet of the frame, NULL if none.
+static reasm_slot_t* find_slot (reasm_table_t* table_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN]) {
+    for (int s=0; s < REASM_SLOT_NUM; s++) {
+        reasm_slot_t* slot_ptr = &table_ptr->slot_list[s];
+        if (slot_ptr->in_use && memcmp(slot_ptr->mac_addr, mac_addr, RFC5444_ADDR_LEN) == 0) {
+            return slot_ptr;
+        }
+    }
+    return NULL;
+}
+
+// the payload len of frame #idx of the packet in the slot.
+static uint8_t cal_seg_len (reasm_slot_t* slot_ptr, uint8_t idx) {
+    if (idx == slot_ptr->seg_num - 1) {
+        return slot_ptr->pkt.pkt_len - idx * ESPNOW_MAX_PAYLOAD_LEN;
+    }
+    return ESPNOW_MAX_PAYLOAD_LEN;
+}
+
+// return the slot if all frames of its packet are there, NULL otherwise.
+static reasm_slot_t* check_complete (reasm_slot_t* slot_ptr) {
+    if (slot_ptr->got_mask != (uint16_t)((1u << slot_ptr->seg_num) - 1)) {
+        return NULL;
+    }
+    ESP_LOGI(TAG, "A new packet received, len = %d", slot_ptr->pkt.pkt_len);
+    return slot_ptr;
+}
+
+// rebuild the lost frame of a parity group, the parity is the XOR of all frames in the group.
+// frames of a sender arrive in order, so all frames of the packet that are not lost are there already.
+static reasm_slot_t* rebuild_frame (reasm_table_t* table_ptr, reasm_slot_t* slot_ptr, uint8_t group, uint8_t* parity, uint8_t parity_len) {
+    int lost_idx = -1;
+    for (int i = group; i < slot_ptr->seg_num; i += ESPNOW_FEC_GROUP_NUM) {
+        if (slot_ptr->got_mask & (1u << i)) continue;
+        if (lost_idx >= 0) {
+            drop_slot(table_ptr, slot_ptr, "frames lost");
+            return NULL;
+        }
+        lost_idx = i;
+    }
+    if (lost_idx < 0) {
+        // nothing lost in this group.
+        return NULL;
+    }
+    uint8_t lost_len = cal_seg_len(slot_ptr, lost_idx);
+    if (lost_len > parity_len) {
+        drop_slot(table_ptr, slot_ptr, "parity too short");
+        return NULL;
+    }
+    uint8_t* lost_ptr = slot_ptr->pkt.pkt_data + lost_idx * ESPNOW_MAX_PAYLOAD_LEN;
+    memcpy(lost_ptr, parity, lost_len);
+    for (int i = group; i < slot_ptr->seg_num; i += ESPNOW_FEC_GROUP_NUM) {
+        if (i == lost_idx) continue;
+        uint8_t* seg_ptr = slot_ptr->pkt.pkt_data + i * ESPNOW_MAX_PAYLOAD_LEN;
+        uint8_t seg_len = cal_seg_len(slot_ptr, i);
+        for (int b = 0; b < seg_len && b < lost_len; b++) {
+            lost_ptr[b] ^= seg_ptr[b];
+        }
+    }
+    slot_ptr->got_mask |= (1u << lost_idx);
+    table_ptr->rebuilt_num ++;
+    ESP_LOGI(TAG, "Rebuilt frame #%d of packet #%d from parity.", lost_idx, slot_ptr->pkt_id);
+    return check_complete(slot_ptr);
+}
+
+// add a checked DATA_START, DATA_MORE, DATA_END or DATA_PARITY frame.
+// return the slot if its packet is completed, the caller handles slot->pkt and then calls reasm_free_slot().
+// return NULL otherwise.
+reasm_slot_t* reasm_add_frame (reasm_table_t* table_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN], espnow_olsr_frame_t* frame_ptr, uint32_t now_ms) {
+    uint8_t payload_len = frame_ptr->len - sizeof(espnow_olsr_frame_t);
+    // a sender sends the frames of one packet in a row, so it has one packet in a slot at most.
+    reasm_slot_t* slot_ptr = find_slot(table_ptr, mac_addr);
+
+    if (frame_ptr->seg_state == ESPNOW_OLSR_DATA_START) {
+        if (slot_ptr != NULL) {
+            drop_slot(table_ptr, slot_ptr, "a new packet starts");
+        }
+        // the packet len is in the packet header, which is in the first frame.
+        if (payload_len < RFC5444_PKT_HEADER_LEN) {
+            ESP_LOGW(TAG, "A first frame without packet header!");
+            return NULL;
+        }
+        uint16_t pkt_len = get_u16(frame_ptr->payload + 2);
+        if (pkt_len <= payload_len || pkt_len > ESPNOW_MAX_PKT_LEN || payload_len != ESPNOW_MAX_PAYLOAD_LEN) {
+            ESP_LOGW(TAG, "A first frame with wrong packet len %d!", pkt_len);
+            return NULL;
+        }
+        slot_ptr = alloc_slot(table_ptr, pkt_len, now_ms);
+        if (slot_ptr == NULL) return NULL;
+        slot_ptr->pkt.pkt_data = malloc(pkt_len);
+        if (slot_ptr->pkt.pkt_data == NULL) {
+            ESP_LOGE(TAG, "No mem for packet reassembly!");
+            return NULL;
+        }
+        slot_ptr->in_use = 1;
+        memcpy(slot_ptr->mac_addr, mac_addr, RFC5444_ADDR_LEN);
+        memcpy(slot_ptr->pkt.mac_addr, mac_addr, RFC5444_ADDR_LEN);
+        slot_ptr->pkt.pkt_len = pkt_len;
+        slot_ptr->pkt_id = frame_ptr->seq_num;
+        slot_ptr->seg_num = ESPNOW_SEG_NUM(pkt_len);
+        slot_ptr->expire_ms = now_ms + REASM_TIMEOUT_MS;
+        table_ptr->mem_used += pkt_len;
+        memcpy(slot_ptr->pkt.pkt_data, frame_ptr->payload, payload_len);
+        slot_ptr->got_mask = 1;
+        return NULL;
+    }
+
+    // DATA_MORE, DATA_END or DATA_PARITY, the seq num tells which frame of the packet it is.
+    if (slot_ptr == NULL) {
+        // the parity frames of a completed packet are not needed.
+        if (frame_ptr->seg_state != ESPNOW_OLSR_DATA_PARITY) {
+            ESP_LOGW(TAG, "A frame without its first frame from "MACSTR"!", MAC2STR(mac_addr));
+        }
+        return NULL;
+    }
+    uint16_t idx = (uint16_t)(frame_ptr->seq_num - slot_ptr->pkt_id);
+    if (frame_ptr->seg_state == ESPNOW_OLSR_DATA_PARITY) {
+        // parity frames follow the last frame, in the order of their groups.
+        if (idx < slot_ptr->seg_num || idx - slot_ptr->seg_num >= ESPNOW_FEC_GROUP_NUM) {
+            drop_slot(table_ptr, slot_ptr, "a wrong parity frame");
+            return NULL;
+        }
+        return rebuild_frame(table_ptr, slot_ptr, idx - slot_ptr->seg_num, frame_ptr->payload, payload_len);
+    }
+    if (idx >= slot_ptr->seg_num || (frame_ptr->seg_state == ESPNOW_OLSR_DATA_END) != (idx == slot_ptr->seg_num - 1)\
+        || payload_len != cal_seg_len(slot_ptr, idx)) {
+        ESP_LOGW(TAG, "A frame out of order from "MACSTR"!", MAC2STR(mac_addr));
+        drop_slot(table_ptr, slot_ptr, "a wrong frame");
+        return NULL;
+    }
+    memcpy(slot_ptr->pkt.pkt_data + idx * ESPNOW_MAX_PAYLOAD_LEN, frame_ptr->payload, payload_len);
+    slot_ptr->got_mask |= (1u << idx);
+    return check_complete(slot_ptr);
+}
@@ -0,0 +1,40 @@
+/*
+ * reassembly of packets sent in multiple ESPNOW frames.
+ * Frames of packets from different senders may interleave, so each packet being received
+ * has its own slot, keyed by the sender mac addr and the packet id (seq num of its first frame).
+ * The num of slots and the bytes they hold are bounded, a slot times out if its packet is not completed.
+ * A lost frame is rebuilt from the parity frame of its group, if it is the only one lost in the group.
+ * The first frame holds the packet len, so it can not be rebuilt.
+ */
+
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+#include "espnow_olsr.h"
+
+#define REASM_SLOT_NUM      4                           // max num of packets being reassembled at the same time
+#define REASM_MEM_CAP       (2 * ESPNOW_MAX_PKT_LEN)    // max bytes held by all slots
+#define REASM_TIMEOUT_MS    200                         // drop a packet not completed in time
+
+typedef struct reasm_slot_t {
+    uint8_t in_use;
+    uint8_t mac_addr[RFC5444_ADDR_LEN];
+    uint16_t pkt_id;            // seq num of the first frame, frame #i has seq num pkt_id + i
+    uint8_t seg_num;            // num of frames of the packet, parity frames not counted
+    uint16_t got_mask;          // bit i is set if frame #i is received or rebuilt
+    uint32_t expire_ms;
+    raw_pkt_t pkt;              // pkt_len is from the packet header, pkt_data is malloced for pkt_len bytes
+} reasm_slot_t;
+
+typedef struct reasm_table_t {
+    reasm_slot_t slot_list[REASM_SLOT_NUM];
+    uint32_t mem_used;
+    uint32_t drop_num;          // num of packets dropped before completed
+    uint32_t rebuilt_num;       // num of frames rebuilt from parity frames
+} reasm_table_t;
+
+void reasm_init (reasm_table_t* table_ptr);
+reasm_slot_t* reasm_add_frame (reasm_table_t* table_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN], espnow_olsr_frame_t* frame_ptr, uint32_t now_ms);
+void reasm_free_slot (reasm_table_t* table_ptr, reasm_slot_t* slot_ptr);
+void reasm_deinit (reasm_table_t* table_ptr);
+
+#endif
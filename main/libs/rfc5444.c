@@ -3,401 +3,677 @@
 static const char *TAG = "espnow_rfc5444";
 
 /* Helper functions */
-uint8_t get_tlv_len (tlv_t* tlv_ptr) {
+
+// read a 16-bit field in network byte order.
+uint16_t get_u16 (const uint8_t* buf) {
+    return ((uint16_t)buf[0] << 8) | buf[1];
+}
+
+/* Link metrics use the 12-bit compressed form of rfc7181 section 6.1:
+ * <a:4><b:8> stands for the metric (257 + b) * 2^a - 256, from 1 to 16776960.
+ * A metric is rounded up to the next value that can be represented.
+ */
+uint16_t compress_metric (uint32_t metric) {
+    if (metric < 1) metric = 1;
+    if (metric >= decompress_metric(0xfff)) return 0xfff; // the max metric
+    for (uint8_t a=0; a < 16; a++) {
+        // smallest b with (257 + b) * 2^a - 256 >= metric
+        uint32_t b = ((metric + 256 + (1 << a) - 1) >> a) - 257;
+        if (b <= 255) return (a << 8) | b;
+    }
+    return 0xfff;
+}
+
+uint32_t decompress_metric (uint16_t comp_metric) {
+    uint8_t a = (comp_metric >> 8) & 0x0f;
+    uint8_t b = comp_metric & 0xff;
+    return ((uint32_t)(257 + b) << a) - 256;
+}
+
+// read a COMP_LINK_METRIC value, <out metric:12><in metric:12>.
+void get_metric_pair (const uint8_t* buf, uint32_t* out_metric_ptr, uint32_t* in_metric_ptr) {
+    *out_metric_ptr = decompress_metric(((uint16_t)buf[0] << 4) | (buf[1] >> 4));
+    *in_metric_ptr = decompress_metric(((uint16_t)(buf[1] & 0x0f) << 8) | buf[2]);
+}
+
+uint16_t get_tlv_len (tlv_t* tlv_ptr) {
     if (tlv_ptr == NULL) return 0;
     return sizeof(tlv_t) + tlv_ptr->tlv_value_len;
 }
 
-// get the specific type of value in the tlv block, return value len.
+#define TLV_MSG_VALUE_LEN(type, msg_len, addr_len, single)      [type] = msg_len,
+#define TLV_ADDR_VALUE_LEN(type, msg_len, addr_len, single)     [type] = addr_len,
+#define TLV_SINGLE_VALUE(type, msg_len, addr_len, single)       [type] = single,
+static const uint8_t tlv_msg_value_len_table[TLV_TYPE_NUM] = { TLV_TYPE_TABLE(TLV_MSG_VALUE_LEN) };
+static const uint8_t tlv_addr_value_len_table[TLV_TYPE_NUM] = { TLV_TYPE_TABLE(TLV_ADDR_VALUE_LEN) };
+// RFC5444_MAX_ADDR_NUM addrs of any addr tlv fit in one tlv value.
+#define TLV_ADDR_VALUE_LEN_CHECK(type, msg_len, addr_len, single) \
+    _Static_assert((addr_len) <= RFC5444_MAX_ADDR_VALUE_LEN, #type " has more bytes per addr than RFC5444_MAX_ADDR_VALUE_LEN");
+TLV_TYPE_TABLE(TLV_ADDR_VALUE_LEN_CHECK)
+static const uint8_t tlv_single_value_table[TLV_TYPE_NUM] = { TLV_TYPE_TABLE(TLV_SINGLE_VALUE) };
+
+// get the specific type of value in the tlv block view, return value len.
 // use a pointer of pointer to pass the pointer to the value.
-uint8_t get_tlv_value (tlv_block_t* tlv_block_ptr, tlv_type_t tt, uint8_t** buf_pp) {
-    if(tlv_block_ptr == NULL) {
+uint8_t get_tlv_value (tlv_block_view_t* tlv_block_ptr, tlv_type_t tt, uint8_t** buf_pp) {
+    if(tlv_block_ptr == NULL || tt >= TLV_TYPE_NUM || tlv_block_ptr->tlv_by_type[tt] == NULL) {
         return 0;
     }
-    tlv_t* tlv_ptr = NULL;
-    for (int t=0; t < tlv_block_ptr->tlv_ptr_len; t++) {
-        tlv_ptr = tlv_block_ptr->tlv_ptr_list[t];
-        if(tlv_ptr->tlv_type == tt) {
-            *buf_pp = tlv_ptr->tlv_value;
-            return tlv_ptr->tlv_value_len;
-        }
-    }
+    *buf_pp = tlv_block_ptr->tlv_by_type[tt]->tlv_value;
+    return tlv_block_ptr->tlv_by_type[tt]->tlv_value_len;
+}
+
+// get the value of the idx-th addr in an addr tlv, NULL if absent.
+// a single-value tlv has the same value for all addrs.
+uint8_t* get_addr_tlv_value (tlv_block_view_t* tlv_block_ptr, tlv_type_t tt, uint8_t idx) {
+    uint8_t* value_ptr = NULL;
+    uint8_t value_len = get_tlv_value(tlv_block_ptr, tt, &value_ptr);
+    if (value_len == 0) return NULL;
+    if (value_len == tlv_addr_value_len_table[tt]) return value_ptr;
+    return value_ptr + idx * tlv_addr_value_len_table[tt];
+}
+
+// get the value of a msg tlv as an unsigned int in network byte order, 0 if absent.
+// the len is checked by check_tlv_block() when the msg is received.
+uint16_t get_tlv_uint (tlv_block_view_t* tlv_block_ptr, tlv_type_t tt) {
+    uint8_t* value_ptr = NULL;
+    uint8_t value_len = get_tlv_value(tlv_block_ptr, tt, &value_ptr);
+    if (value_len == 1) return value_ptr[0];
+    if (value_len == 2) return get_u16(value_ptr);
     return 0;
 }
 
+// len of a msg tlv entry, header included.
 uint8_t cal_tlv_len (tlv_type_t type) {
-    switch (type) {
-        case VALIDITY_TIME: {
-            return sizeof(tlv_t) + 1;
-        }
-        case INTERVAL_TIME: {
-            return sizeof(tlv_t) + 1;
-        }
-        case MPR_WILLING: {
-            return sizeof(tlv_t) + 1;
+    if (type >= TLV_TYPE_NUM || tlv_msg_value_len_table[type] == 0) {
+        ESP_LOGW(TAG, "Unknown tlv type!");
+        return 0;
+    }
+    return sizeof(tlv_t) + tlv_msg_value_len_table[type];
+}
+
+// len of an addr tlv entry for addr_num addrs, header included.
+uint16_t cal_addr_tlv_len (tlv_type_t type, uint8_t addr_num) {
+    if (type >= TLV_TYPE_NUM || tlv_addr_value_len_table[type] == 0) {
+        ESP_LOGW(TAG, "Unknown tlv type!");
+        return 0;
+    }
+    return sizeof(tlv_t) + tlv_addr_value_len_table[type] * addr_num;
+}
+
+// len of a tlv block of the schema, block header included.
+// addr_num is ignored for a msg tlv block.
+uint16_t cal_tlv_block_len (const tlv_schema_t* schema_ptr, uint8_t addr_num) {
+    uint16_t block_len = sizeof(tlv_block_t);
+    for (int t=0; t < schema_ptr->tlv_num; t++) {
+        if (!schema_ptr->is_addr) {
+            block_len += cal_tlv_len(schema_ptr->type_list[t]);
+        } else {
+            block_len += cal_addr_tlv_len(schema_ptr->type_list[t], addr_num);
         }
-        default: {
-            ESP_LOGW(TAG, "Unknown tlv type!");
+    }
+    return block_len;
+}
+
+// check a received tlv block has every tlv of the schema with the right value len.
+// addr_num is ignored for a msg tlv block. Other tlvs in the block are allowed and ignored.
+uint8_t check_tlv_block (tlv_block_view_t* tlv_block_ptr, const tlv_schema_t* schema_ptr, uint8_t addr_num) {
+    for (int t=0; t < schema_ptr->tlv_num; t++) {
+        tlv_type_t tt = schema_ptr->type_list[t];
+        tlv_t* tlv_ptr = tlv_block_ptr->tlv_by_type[tt];
+        uint16_t value_len = !schema_ptr->is_addr ? tlv_msg_value_len_table[tt] : tlv_addr_value_len_table[tt] * addr_num;
+        if (tlv_ptr == NULL) return 0;
+        // a single-value addr tlv has one value for all addrs.
+        if (tlv_ptr->tlv_value_len != value_len\
+            && !(schema_ptr->is_addr && tlv_single_value_table[tt] && addr_num > 0 && tlv_ptr->tlv_value_len == tlv_addr_value_len_table[tt])) {
             return 0;
         }
     }
+    return 1;
 }
 
-void free_tlv_block (tlv_block_t* tlv_block_ptr) {
-    if (tlv_block_ptr == NULL) {
-        // empty tlv block
-        return;
+// rebuild the idx-th addr of the block from its run's head, mid and tail.
+void get_addr (addr_block_view_t* addr_block_ptr, uint8_t idx, uint8_t addr[RFC5444_ADDR_LEN]) {
+    assert(idx < addr_block_ptr->addr_num);
+    int r = addr_block_ptr->run_num - 1;
+    while (r > 0 && addr_block_ptr->run_list[r].start_idx > idx) r--;
+    addr_run_view_t* run_ptr = &addr_block_ptr->run_list[r];
+    if (run_ptr->head_len > 0) {
+        memcpy(addr, run_ptr->head_ptr, run_ptr->head_len);
     }
-    // free tlv_ptr entries
-    for(int i=0; i < tlv_block_ptr->tlv_ptr_len; i++) {
-        free(tlv_block_ptr->tlv_ptr_list[i]);
+    memcpy(addr + run_ptr->head_len, run_ptr->mid_ptr + (idx - run_ptr->start_idx) * run_ptr->mid_len, run_ptr->mid_len);
+    if (run_ptr->zero_tail) {
+        memset(addr + RFC5444_ADDR_LEN - run_ptr->tail_len, 0, run_ptr->tail_len);
+    } else if (run_ptr->tail_len > 0) {
+        memcpy(addr + RFC5444_ADDR_LEN - run_ptr->tail_len, run_ptr->tail_ptr, run_ptr->tail_len);
     }
-    // must free tlv_block itself.
-    free(tlv_block_ptr);
 }
 
-uint16_t get_tlv_block_len (tlv_block_t* tlv_block) {
-    if (tlv_block == NULL) return 0;
+typedef struct addr_run_t {
+    uint8_t start_idx;
+    uint8_t addr_num;
+    uint8_t head_len;
+    uint8_t tail_len;
+    uint8_t flags;
+} addr_run_t;
+
+// num of leading bytes shared by two addrs
+static inline uint8_t common_head_len (uint8_t* a, uint8_t* b) {
+    uint8_t len = 0;
+    while (len < RFC5444_ADDR_LEN && a[len] == b[len]) len++;
+    return len;
+}
+
+// num of trailing bytes shared by two addrs
+static inline uint8_t common_tail_len (uint8_t* a, uint8_t* b) {
+    uint8_t len = 0;
+    while (len < RFC5444_ADDR_LEN && a[RFC5444_ADDR_LEN - 1 - len] == b[RFC5444_ADDR_LEN - 1 - len]) len++;
+    return len;
+}
 
-    uint16_t ret_len = sizeof(tlv_block_t);
-    for(int i=0; i < tlv_block->tlv_ptr_len; i++) {
-        ret_len += tlv_block->tlv_ptr_list[i]->tlv_value_len + sizeof(tlv_t);
+// decide the head/tail of a run of addrs addr_table[id_list[start_idx .. start_idx+addr_num)].
+static void fill_addr_run (uint8_t addr_table[][RFC5444_ADDR_LEN], uint8_t* id_list, addr_run_t* run_ptr) {
+    uint8_t* first_ptr = addr_table[id_list[run_ptr->start_idx]];
+    uint8_t tmp_len = 0;
+    // at least one mid byte is left
+    run_ptr->head_len = RFC5444_ADDR_LEN - 1;
+    run_ptr->tail_len = RFC5444_ADDR_LEN - 1;
+    for (int i=run_ptr->start_idx + 1; i < run_ptr->start_idx + run_ptr->addr_num; i++) {
+        tmp_len = common_head_len(first_ptr, addr_table[id_list[i]]);
+        if (tmp_len < run_ptr->head_len) run_ptr->head_len = tmp_len;
+        tmp_len = common_tail_len(first_ptr, addr_table[id_list[i]]);
+        if (tmp_len < run_ptr->tail_len) run_ptr->tail_len = tmp_len;
     }
-    // double check
-    // ESP_LOGI(TAG, "ret_len = %d, tlv_block_len = %d", ret_len, sizeof(tlv_block_t) + tlv_block->tlv_block_size);
-    assert(ret_len == sizeof(tlv_block_t) + tlv_block->tlv_block_size);
+    run_ptr->flags = NORMAL_ADDR;
+    // a head costs one length byte, only use it if it saves bytes.
+    if (run_ptr->head_len * (run_ptr->addr_num - 1) <= 1) run_ptr->head_len = 0;
+    if (run_ptr->head_len > 0) run_ptr->flags |= ADDR_FLAG_HAS_HEAD;
+    if (run_ptr->tail_len > RFC5444_ADDR_LEN - 1 - run_ptr->head_len) {
+        run_ptr->tail_len = RFC5444_ADDR_LEN - 1 - run_ptr->head_len;
+    }
+    // a zero tail only costs the length byte.
+    uint8_t zero_tail = 1;
+    for (int t=RFC5444_ADDR_LEN - run_ptr->tail_len; t < RFC5444_ADDR_LEN; t++) {
+        if (first_ptr[t] != 0) zero_tail = 0;
+    }
+    if (run_ptr->tail_len > 0 && zero_tail) {
+        run_ptr->flags |= ADDR_FLAG_HAS_ZERO_TAIL;
+    } else if (run_ptr->tail_len * (run_ptr->addr_num - 1) > 1) {
+        run_ptr->flags |= ADDR_FLAG_HAS_FULL_TAIL;
+    } else {
+        run_ptr->tail_len = 0;
+    }
+}
+
+static inline uint16_t cal_addr_run_len (addr_run_t* run_ptr) {
+    uint16_t ret_len = 2; // run addr num and flags
+    if (run_ptr->flags & ADDR_FLAG_HAS_HEAD) ret_len += 1 + run_ptr->head_len;
+    if (run_ptr->flags & ADDR_FLAG_HAS_FULL_TAIL) ret_len += 1 + run_ptr->tail_len;
+    if (run_ptr->flags & ADDR_FLAG_HAS_ZERO_TAIL) ret_len += 1;
+    ret_len += run_ptr->addr_num * (RFC5444_ADDR_LEN - run_ptr->head_len - run_ptr->tail_len);
     return ret_len;
 }
 
-// copy the content of a tlv_block and return the num of bytes copied.
-uint16_t copy_from_tlv_block (uint8_t* dst_buf, tlv_block_t* src_block) {
-    uint16_t offset = 0;
-    if(dst_buf == NULL || src_block==NULL) {
-        return 0;
+// split the addrs into runs and decide the head/tail of each run.
+// addrs are addr_table[id_list[i]], callers should sort them so that shared heads are adjacent.
+// return the num of runs.
+static uint8_t split_addr_runs (uint8_t addr_table[][RFC5444_ADDR_LEN], uint8_t* id_list, uint8_t addr_num, addr_run_t* run_list) {
+    uint8_t run_num = 0;
+    addr_run_t* run_ptr = NULL;
+    // 1. cut where sorted addrs stop sharing an OUI.
+    for (int i=0; i < addr_num; i++) {
+        if (run_ptr == NULL || (run_num < RFC5444_MAX_ADDR_RUN &&\
+                common_head_len(addr_table[id_list[i-1]], addr_table[id_list[i]]) < ADDR_RUN_MIN_HEAD)) {
+            run_ptr = &run_list[run_num++];
+            run_ptr->start_idx = i;
+            run_ptr->addr_num = 0;
+        }
+        run_ptr->addr_num ++;
     }
-    memcpy(dst_buf + offset, (uint8_t*)src_block, sizeof(tlv_block_t));
-    offset += sizeof(tlv_block_t);
-    for(int i=0; i < src_block->tlv_ptr_len; i++) {
-        uint8_t tmp_len = get_tlv_len(src_block->tlv_ptr_list[i]);
-        memcpy(dst_buf + offset, (uint8_t*)(src_block->tlv_ptr_list[i]), tmp_len);
-        offset += tmp_len;
+    for (int r=0; r < run_num; r++) {
+        fill_addr_run(addr_table, id_list, &run_list[r]);
+    }
+    // 2. each run costs a few header bytes, merge neighbor runs back if that is not larger.
+    addr_run_t merged_run;
+    int r = 0;
+    while (r + 1 < run_num) {
+        merged_run.start_idx = run_list[r].start_idx;
+        merged_run.addr_num = run_list[r].addr_num + run_list[r+1].addr_num;
+        fill_addr_run(addr_table, id_list, &merged_run);
+        if (cal_addr_run_len(&merged_run) <= cal_addr_run_len(&run_list[r]) + cal_addr_run_len(&run_list[r+1])) {
+            run_list[r] = merged_run;
+            memmove(&run_list[r+1], &run_list[r+2], (run_num - r - 2) * sizeof(addr_run_t));
+            run_num --;
+        } else {
+            r ++;
+        }
     }
-    assert(offset == get_tlv_block_len(src_block));
-    return offset;
+    return run_num;
 }
 
-// copy the content of buf to tlv_block and return the num of bytes copied.
-// this function requires that the mem is allocated for tlv_block.
-uint16_t copy_to_tlv_block (uint8_t* src_buf, tlv_block_t* dst_block) {
-    uint16_t offset = 0;
-    uint8_t* dst_ptr = (uint8_t*) dst_block;
-    if(src_buf == NULL || dst_ptr == NULL) {
-        return 0;
+// the num of bytes gen_addr_block() will write for the same addrs.
+uint16_t cal_addr_block_len (uint8_t addr_table[][RFC5444_ADDR_LEN], uint8_t* id_list, uint8_t addr_num) {
+    addr_run_t run_list[RFC5444_MAX_ADDR_RUN];
+    uint8_t run_num = split_addr_runs(addr_table, id_list, addr_num, run_list);
+    uint16_t ret_len = sizeof(addr_block_t);
+    for (int r=0; r < run_num; r++) {
+        ret_len += cal_addr_run_len(&run_list[r]);
     }
-    // copy the tlv block
-    // 1. copy to tlv block header.
-    memcpy(dst_ptr, src_buf, sizeof(tlv_block_t));
-    offset += sizeof(tlv_block_t);
-    // 2. copy to tlv entries (alloc mem first)
-    for(int i=0; i < dst_block->tlv_ptr_len; i++) {
-        tlv_t* tmp_tlv_ptr = (tlv_t*) (src_buf + offset);
-        uint8_t tmp_len = get_tlv_len(tmp_tlv_ptr);
-        dst_block->tlv_ptr_list[i] = malloc(tmp_len);
-        if (dst_block->tlv_ptr_list[i] == NULL) {
-            ESP_LOGE(TAG, "No mem for new tlv entry!");
-            return 0;
+    return ret_len;
+}
+
+// write the compressed addr block of addrs addr_table[id_list[i]], i in [0, addr_num).
+void gen_addr_block (pkt_writer_t* writer_ptr, uint8_t addr_table[][RFC5444_ADDR_LEN], uint8_t* id_list, uint8_t addr_num) {
+    addr_run_t run_list[RFC5444_MAX_ADDR_RUN];
+    uint8_t run_num = split_addr_runs(addr_table, id_list, addr_num, run_list);
+    pkt_write_u8(writer_ptr, addr_num);
+    for (int r=0; r < run_num; r++) {
+        addr_run_t* run_ptr = &run_list[r];
+        uint8_t* first_ptr = addr_table[id_list[run_ptr->start_idx]];
+        uint8_t mid_len = RFC5444_ADDR_LEN - run_ptr->head_len - run_ptr->tail_len;
+        pkt_write_u8(writer_ptr, run_ptr->addr_num);
+        pkt_write_u8(writer_ptr, run_ptr->flags);
+        if (run_ptr->flags & ADDR_FLAG_HAS_HEAD) {
+            pkt_write_u8(writer_ptr, run_ptr->head_len);
+            pkt_write(writer_ptr, first_ptr, run_ptr->head_len);
+        }
+        if (run_ptr->flags & (ADDR_FLAG_HAS_FULL_TAIL | ADDR_FLAG_HAS_ZERO_TAIL)) {
+            pkt_write_u8(writer_ptr, run_ptr->tail_len);
+        }
+        if (run_ptr->flags & ADDR_FLAG_HAS_FULL_TAIL) {
+            pkt_write(writer_ptr, first_ptr + RFC5444_ADDR_LEN - run_ptr->tail_len, run_ptr->tail_len);
+        }
+        for (int i=run_ptr->start_idx; i < run_ptr->start_idx + run_ptr->addr_num; i++) {
+            pkt_write(writer_ptr, addr_table[id_list[i]] + run_ptr->head_len, mid_len);
         }
-        // copy one tlv entry
-        memcpy(dst_block->tlv_ptr_list[i], src_buf + offset, tmp_len);
-        offset += tmp_len;
     }
-    // check offset is correct
-    assert(offset == get_tlv_block_len(dst_block));
-    return offset;
 }
 
-
-uint16_t get_addr_block_len (addr_block_t* addr_block_ptr) {
-    if (addr_block_ptr == NULL) return 0;
-    return sizeof(addr_block_t) + addr_block_ptr->addr_num * RFC5444_ADDR_LEN;
+// the len of a framed tx buffer that can hold a packet of pkt_len bytes.
+uint16_t cal_framed_buf_len (uint16_t pkt_len, uint16_t seg_head_len, uint16_t seg_payload_len) {
+    uint16_t seg_num = (pkt_len + seg_payload_len - 1) / seg_payload_len;
+    return seg_num * (seg_head_len + seg_payload_len);
 }
 
-uint16_t copy_from_addr_block (uint8_t* dst_buf, addr_block_t* addr_block_ptr) {
-    if (dst_buf == NULL || addr_block_ptr == NULL) return 0;
-    uint16_t ret_len = get_addr_block_len(addr_block_ptr);
-    memcpy(dst_buf, (uint8_t*)addr_block_ptr, ret_len);
-    return ret_len;
+// set seg_payload_len to 0 to write a flat buffer.
+void pkt_writer_init (pkt_writer_t* writer_ptr, uint8_t* buf, uint16_t seg_head_len, uint16_t seg_payload_len) {
+    writer_ptr->buf = buf;
+    writer_ptr->offset = 0;
+    writer_ptr->seg_head_len = seg_head_len;
+    writer_ptr->seg_payload_len = seg_payload_len;
 }
 
-// copy the content of msg_data to hello_msg and return the num of bytes copied.
-// this function requires the mem is allocated for hello_msg alraedy.
-uint16_t copy_to_hello_msg(uint8_t* msg_data, hello_msg_t* hello_msg_ptr) {
-    uint16_t offset = 0;
-    uint16_t tmp_len = 0;
-    uint8_t* dst_ptr = (uint8_t*) hello_msg_ptr;
-    if (msg_data == NULL || dst_ptr == NULL) {
-        ESP_LOGW(TAG, "NULL data input!");
-        return 0;
-    }
-    // copy hello msg
-    // 1. copy hello msg header
-    memcpy(dst_ptr, msg_data, sizeof(msg_header_t));
-    offset += sizeof(msg_header_t);
-    // TODO: what if we do not have all blocks in a msg.
-    // 2. copy all the blocks (alloc mem first)
-    // (1) copy msg_tlv block
-    tlv_block_t* tmp_tlv_block_ptr = (tlv_block_t*)(msg_data + offset);
-    // this length is special since we store a list of pointers instead of tlv data.
-    tmp_len = sizeof(tlv_block_t) + tmp_tlv_block_ptr->tlv_ptr_len * sizeof(tlv_t*);
-    hello_msg_ptr->msg_tlv_block_ptr = malloc(tmp_len);
-    if (hello_msg_ptr->msg_tlv_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for tlv_block!");
-        return 0;
-    }
-    memset(hello_msg_ptr->msg_tlv_block_ptr, 0, tmp_len);
-    // copy the msg_tlv block
-    offset += copy_to_tlv_block(msg_data + offset, hello_msg_ptr->msg_tlv_block_ptr);
-    // (2) copy the addr block
-    addr_block_t* tmp_addr_block_ptr = (addr_block_t*)(msg_data + offset);
-    tmp_len = get_addr_block_len(tmp_addr_block_ptr);
-    hello_msg_ptr->addr_block_ptr = malloc(tmp_len);
-    if (hello_msg_ptr->addr_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr_block!");
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        return 0;
+// write len bytes at the cursor, skip the frame headers if the buffer is framed.
+void pkt_write (pkt_writer_t* writer_ptr, const void* src, uint16_t len) {
+    const uint8_t* src_ptr = (const uint8_t*) src;
+    if (writer_ptr->seg_payload_len == 0) {
+        memcpy(writer_ptr->buf + writer_ptr->offset, src_ptr, len);
+        writer_ptr->offset += len;
+        return;
     }
-    memcpy(hello_msg_ptr->addr_block_ptr, msg_data + offset, tmp_len);
-    offset += tmp_len;
-    // (3) copy addr tlv block
-    tmp_tlv_block_ptr = (tlv_block_t*)(msg_data + offset);
-    // this length is special since we store a list of pointers instead of tlv data.
-    tmp_len = sizeof(tlv_block_t) + tmp_tlv_block_ptr->tlv_ptr_len * sizeof(tlv_t*);
-    hello_msg_ptr->addr_tlv_block_ptr = malloc(tmp_len);
-    if (hello_msg_ptr->addr_tlv_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr tlv_block!");
-        free(hello_msg_ptr->msg_tlv_block_ptr);
-        free(hello_msg_ptr->addr_block_ptr);
-        return 0;
+    while (len > 0) {
+        uint16_t seg_idx = writer_ptr->offset / writer_ptr->seg_payload_len;
+        uint16_t seg_offset = writer_ptr->offset % writer_ptr->seg_payload_len;
+        uint16_t tmp_len = writer_ptr->seg_payload_len - seg_offset;
+        if (tmp_len > len) tmp_len = len;
+        memcpy(writer_ptr->buf + seg_idx * (writer_ptr->seg_head_len + writer_ptr->seg_payload_len)\
+                + writer_ptr->seg_head_len + seg_offset, src_ptr, tmp_len);
+        writer_ptr->offset += tmp_len;
+        src_ptr += tmp_len;
+        len -= tmp_len;
     }
-    memset(hello_msg_ptr->addr_tlv_block_ptr, 0, tmp_len);
-    // copy the addr_tlv block
-    offset += copy_to_tlv_block(msg_data + offset, hello_msg_ptr->addr_tlv_block_ptr);
+}
 
-    // 3. check offset
-    assert(offset == sizeof(msg_header_t) + hello_msg_ptr->header.msg_size);
-    return offset;
+void pkt_write_u8 (pkt_writer_t* writer_ptr, uint8_t value) {
+    pkt_write(writer_ptr, &value, 1);
 }
 
-// copy the content of msg_data to tc_msg and return the num of bytes copied.
-// this function requires the mem is allocated for tc_msg alraedy.
-uint16_t copy_to_tc_msg(uint8_t* msg_data, tc_msg_t* tc_msg_ptr) {
-    uint16_t offset = 0;
-    uint16_t tmp_len = 0;
-    uint8_t* dst_ptr = (uint8_t*) tc_msg_ptr;
-    if (msg_data == NULL || dst_ptr == NULL) {
-        ESP_LOGW(TAG, "NULL data input!");
-        return 0;
-    }
-    // copy TC msg
-    // 1. copy tc msg header
-    memcpy(dst_ptr, msg_data, sizeof(msg_header_t));
-    offset += sizeof(msg_header_t);
-    // we assume that all blocks exist in this msg
-    // 2. copy all the blocks (alloc mem first)
-    // (1) copy msg_tlv block
-    tlv_block_t* tmp_tlv_block_ptr = (tlv_block_t*)(msg_data + offset);
-    // this length is special since we store a list of pointers instead of tlv data.
-    tmp_len = sizeof(tlv_block_t) + tmp_tlv_block_ptr->tlv_ptr_len * sizeof(tlv_t*);
-    tc_msg_ptr->msg_tlv_block_ptr = malloc(tmp_len);
-    if (tc_msg_ptr->msg_tlv_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for tlv_block!");
-        return 0;
-    }
-    memset(tc_msg_ptr->msg_tlv_block_ptr, 0, tmp_len);
-    // copy the msg_tlv block
-    offset += copy_to_tlv_block(msg_data + offset, tc_msg_ptr->msg_tlv_block_ptr);
-    // (2) copy the addr block
-    addr_block_t* tmp_addr_block_ptr = (addr_block_t*)(msg_data + offset);
-    tmp_len = get_addr_block_len(tmp_addr_block_ptr);
-    tc_msg_ptr->addr_block_ptr = malloc(tmp_len);
-    if (tc_msg_ptr->addr_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr_block!");
-        free(tc_msg_ptr->msg_tlv_block_ptr);
-        return 0;
-    }
-    memcpy(tc_msg_ptr->addr_block_ptr, msg_data + offset, tmp_len);
-    offset += tmp_len;
-    // (3) copy addr tlv block
-    tmp_tlv_block_ptr = (tlv_block_t*)(msg_data + offset);
-    // this length is special since we store a list of pointers instead of tlv data.
-    tmp_len = sizeof(tlv_block_t) + tmp_tlv_block_ptr->tlv_ptr_len * sizeof(tlv_t*);
-    tc_msg_ptr->addr_tlv_block_ptr = malloc(tmp_len);
-    if (tc_msg_ptr->addr_tlv_block_ptr == NULL) {
-        ESP_LOGE(TAG, "No mem for addr tlv_block!");
-        free(tc_msg_ptr->msg_tlv_block_ptr);
-        free(tc_msg_ptr->addr_block_ptr);
-        return 0;
-    }
-    memset(tc_msg_ptr->addr_tlv_block_ptr, 0, tmp_len);
-    // copy the addr_tlv block
-    offset += copy_to_tlv_block(msg_data + offset, tc_msg_ptr->addr_tlv_block_ptr);
+// write a 16-bit field in network byte order.
+void pkt_write_u16 (pkt_writer_t* writer_ptr, uint16_t value) {
+    pkt_write_u8(writer_ptr, value >> 8);
+    pkt_write_u8(writer_ptr, value & 0xff);
+}
 
-    // 3. check offset
-    assert(offset == sizeof(msg_header_t) + tc_msg_ptr->header.msg_size);
-    return offset;
-}
-
-
-void free_rfc5444_pkt (rfc5444_pkt_t pkt) {
-    // free possible hello msg
-    if (pkt.hello_msg_ptr != NULL) {
-        if (pkt.hello_msg_ptr->msg_tlv_block_ptr != NULL)
-            free_tlv_block(pkt.hello_msg_ptr->msg_tlv_block_ptr);
-        if (pkt.hello_msg_ptr->addr_block_ptr != NULL)
-            free(pkt.hello_msg_ptr->addr_block_ptr);
-        if (pkt.hello_msg_ptr->addr_tlv_block_ptr != NULL)
-            free_tlv_block(pkt.hello_msg_ptr->addr_tlv_block_ptr);
-        // free msg struct after free all blocks
-        free(pkt.hello_msg_ptr);
+void gen_pkt_header (pkt_writer_t* writer_ptr, uint16_t pkt_len) {
+    pkt_write_u8(writer_ptr, PKT_VERSION);
+    pkt_write_u8(writer_ptr, PKT_FLAGS);
+    pkt_write_u16(writer_ptr, pkt_len);
+}
+
+// the len of the msg header on the wire, it depends on which optional fields are there.
+uint8_t cal_msg_header_len (uint8_t msg_flags) {
+    uint8_t ret_len = MSG_HEADER_MIN_LEN;
+    if (msg_flags & MSG_FLAG_HAS_ORIG) ret_len += RFC5444_ADDR_LEN;
+    if (msg_flags & MSG_FLAG_HAS_HOP_LIMIT) ret_len += 1;
+    if (msg_flags & MSG_FLAG_HAS_HOP_COUNT) ret_len += 1;
+    if (msg_flags & MSG_FLAG_HAS_SEQ_NUM) ret_len += 2;
+    return ret_len;
+}
+
+// write the msg header field by field, only the fields in msg_flags are written.
+void gen_msg_header (pkt_writer_t* writer_ptr, msg_header_t* header_ptr) {
+    uint8_t msg_flags = header_ptr->msg_flags & 0x0f;
+    pkt_write_u8(writer_ptr, header_ptr->msg_type);
+    pkt_write_u8(writer_ptr, (msg_flags << 4) | (header_ptr->msg_addr_len & 0x0f));
+    pkt_write_u16(writer_ptr, cal_msg_header_len(msg_flags) + header_ptr->msg_size);
+    if (msg_flags & MSG_FLAG_HAS_ORIG) pkt_write(writer_ptr, header_ptr->msg_orig_addr, RFC5444_ADDR_LEN);
+    if (msg_flags & MSG_FLAG_HAS_HOP_LIMIT) pkt_write_u8(writer_ptr, header_ptr->msg_hop_limit);
+    if (msg_flags & MSG_FLAG_HAS_HOP_COUNT) pkt_write_u8(writer_ptr, header_ptr->msg_hop_count);
+    if (msg_flags & MSG_FLAG_HAS_SEQ_NUM) pkt_write_u16(writer_ptr, header_ptr->msg_seq_num);
+}
+
+void gen_tlv_block_header (pkt_writer_t* writer_ptr, uint8_t tlv_num, uint16_t tlv_block_size) {
+    pkt_write_u8(writer_ptr, 0); // tlv_block_type
+    pkt_write_u8(writer_ptr, tlv_num);
+    pkt_write_u16(writer_ptr, tlv_block_size);
+}
+
+// write the header of a tlv block of the schema. addr_num is ignored for a msg tlv block.
+void gen_tlv_block_header_by_schema (pkt_writer_t* writer_ptr, const tlv_schema_t* schema_ptr, uint8_t addr_num) {
+    gen_tlv_block_header(writer_ptr, schema_ptr->tlv_num, cal_tlv_block_len(schema_ptr, addr_num) - sizeof(tlv_block_t));
+}
+
+// write a tlv entry. If value_ptr is NULL, only the tlv header is written
+// and the caller must write value_len bytes of value right after.
+void gen_tlv (pkt_writer_t* writer_ptr, tlv_type_t tt, uint8_t value_len, const uint8_t* value_ptr) {
+    pkt_write_u8(writer_ptr, tt);
+    pkt_write_u8(writer_ptr, value_len);
+    if (value_ptr != NULL) {
+        pkt_write(writer_ptr, value_ptr, value_len);
     }
-    // free possible tc msg
-    if (pkt.tc_msg_ptr != NULL) {
-        if (pkt.tc_msg_ptr->msg_tlv_block_ptr != NULL)
-            free_tlv_block(pkt.tc_msg_ptr->msg_tlv_block_ptr);
-        if (pkt.tc_msg_ptr->addr_block_ptr != NULL)
-            free(pkt.tc_msg_ptr->addr_block_ptr);
-        if (pkt.tc_msg_ptr->addr_tlv_block_ptr != NULL)
-            free_tlv_block(pkt.tc_msg_ptr->addr_tlv_block_ptr);
-        // free msg struct after free all blocks
-        free(pkt.tc_msg_ptr);
+}
+
+// write a msg tlv entry with an unsigned int value, in network byte order.
+void gen_tlv_uint (pkt_writer_t* writer_ptr, tlv_type_t tt, uint16_t value) {
+    uint8_t value_len = cal_tlv_len(tt) - sizeof(tlv_t);
+    gen_tlv(writer_ptr, tt, value_len, NULL);
+    if (value_len == 2) {
+        pkt_write_u16(writer_ptr, value);
+    } else {
+        pkt_write_u8(writer_ptr, value);
     }
-    return;
 }
+
+// write the header of an addr tlv entry, the caller writes the addr_num values right after.
+// a msg has at most RFC5444_MAX_ADDR_NUM addrs, so that the value len fits in its byte. see split_msg_parts()
+void gen_addr_tlv_header (pkt_writer_t* writer_ptr, tlv_type_t tt, uint8_t addr_num) {
+    uint16_t value_len = cal_addr_tlv_len(tt, addr_num) - sizeof(tlv_t);
+    assert(addr_num <= RFC5444_MAX_ADDR_NUM && value_len <= RFC5444_MAX_TLV_VALUE_LEN);
+    gen_tlv(writer_ptr, tt, value_len, NULL);
+}
+
+// write a COMP_LINK_METRIC value, see get_metric_pair().
+void gen_metric_pair (pkt_writer_t* writer_ptr, uint32_t out_metric, uint32_t in_metric) {
+    uint16_t comp_out = compress_metric(out_metric);
+    uint16_t comp_in = compress_metric(in_metric);
+    pkt_write_u8(writer_ptr, comp_out >> 4);
+    pkt_write_u8(writer_ptr, ((comp_out & 0x0f) << 4) | (comp_in >> 8));
+    pkt_write_u8(writer_ptr, comp_in & 0xff);
+}
+
+// write a received msg, e.g. to forward a TC msg.
+// the msg body is copied from the raw buffer, the header is written from the (updated) view header.
+void gen_forward_msg (pkt_writer_t* writer_ptr, msg_view_t* msg_view_ptr) {
+    uint8_t header_len = cal_msg_header_len(msg_view_ptr->header.msg_flags);
+    gen_msg_header(writer_ptr, &msg_view_ptr->header);
+    pkt_write(writer_ptr, msg_view_ptr->msg_data + header_len, msg_view_ptr->msg_len - header_len);
+}
+
+/* A HELLO or TC msg too long for one frame is split at addr boundaries into parts. Each part is a msg on its own
+ * with a PART_ADDR_RANGE msg tlv, the ranges of the parts cover all addrs. A part only replaces the links in its
+ * range, so a lost part only loses the links in it and no reassembly is needed. A msg not split has no such tlv.
+ */
+#define PART_MSG_TLV_SCHEMA(X) \
+    X(PART_ADDR_RANGE)
+DEFINE_MSG_TLV_SCHEMA(part_msg_tlv_schema, PART_MSG_TLV_SCHEMA)
+
+// get the addr range of a msg part, 2 addrs. *range_pp is NULL if the msg is not split.
+// return 0 if the range tlv is malformed.
+uint8_t get_part_range (tlv_block_view_t* tlv_block_ptr, uint8_t** range_pp) {
+    *range_pp = NULL;
+    if (tlv_block_ptr->tlv_by_type[PART_ADDR_RANGE] == NULL) return 1;
+    if (!check_tlv_block(tlv_block_ptr, &part_msg_tlv_schema, 0)) return 0;
+    *range_pp = tlv_block_ptr->tlv_by_type[PART_ADDR_RANGE]->tlv_value;
+    return 1;
+}
+
+// whether the addr is in [first addr, second addr) of the range, a msg not split (NULL range) covers all addrs.
+uint8_t is_addr_in_part (const uint8_t* range_ptr, const uint8_t addr[RFC5444_ADDR_LEN]) {
+    if (range_ptr == NULL) return 1;
+    return memcmp(addr, range_ptr, RFC5444_ADDR_LEN) >= 0 && memcmp(addr, range_ptr + RFC5444_ADDR_LEN, RFC5444_ADDR_LEN) < 0;
+}
+
+// the size of a msg tlv block of the schema, a msg part also has its PART_ADDR_RANGE.
+uint16_t cal_msg_tlv_block_len (const tlv_schema_t* schema_ptr, uint8_t is_part) {
+    return cal_tlv_block_len(schema_ptr, 0) + (is_part ? cal_tlv_len(PART_ADDR_RANGE) : 0);
+}
+
+// write the header of a msg tlv block of the schema, the PART_ADDR_RANGE of a msg part follows the tlvs of the schema.
+void gen_msg_tlv_block_header (pkt_writer_t* writer_ptr, const tlv_schema_t* schema_ptr, uint8_t is_part) {
+    gen_tlv_block_header(writer_ptr, schema_ptr->tlv_num + (is_part ? 1 : 0), cal_msg_tlv_block_len(schema_ptr, is_part) - sizeof(tlv_block_t));
+}
+
+// write the PART_ADDR_RANGE msg tlv of a part covering [lo_addr, hi_addr).
+void gen_part_range_tlv (pkt_writer_t* writer_ptr, const uint8_t lo_addr[RFC5444_ADDR_LEN], const uint8_t hi_addr[RFC5444_ADDR_LEN]) {
+    gen_tlv(writer_ptr, PART_ADDR_RANGE, cal_tlv_len(PART_ADDR_RANGE) - sizeof(tlv_t), NULL);
+    pkt_write(writer_ptr, lo_addr, RFC5444_ADDR_LEN);
+    pkt_write(writer_ptr, hi_addr, RFC5444_ADDR_LEN);
+}
+
 /* Helper functions End */
 
 
 /* Worker Functions */
 
-// after use this rfc5444_pkt_t, remember to free all mem ...
-rfc5444_pkt_t parse_raw_packet (raw_pkt_t raw_packet) {
-    // only copy mem from raw_packet, do not free it. Event loop will reuse it.
-    assert(raw_packet.pkt_len >= 2);
-    rfc5444_pkt_t ret_pkt;
-    // assign values 0x0
-    memset((void*)(&ret_pkt), 0, sizeof(rfc5444_pkt_t));
+// check a tlv block in the raw buffer and fill the view with pointers to its entries.
+// return the num of bytes of the block, or 0 if the block does not fit in [buf, buf_end).
+uint16_t parse_tlv_block_view (uint8_t* buf, uint8_t* buf_end, tlv_block_view_t* view_ptr) {
+    if (buf + sizeof(tlv_block_t) > buf_end) return 0;
+    tlv_block_t* block_ptr = (tlv_block_t*) buf;
+    uint16_t tlv_block_size = get_u16((uint8_t*)&block_ptr->tlv_block_size);
+    uint8_t* block_end = buf + sizeof(tlv_block_t) + tlv_block_size;
+    if (block_end > buf_end) return 0;
+
+    view_ptr->tlv_num = block_ptr->tlv_ptr_len;
+    view_ptr->tlv_block_size = tlv_block_size;
+    memset(view_ptr->tlv_by_type, 0, sizeof(view_ptr->tlv_by_type));
+    uint8_t* tlv_ptr = buf + sizeof(tlv_block_t);
+    for (int i=0; i < view_ptr->tlv_num; i++) {
+        // the tlv header and its value must be inside the block
+        if (tlv_ptr + sizeof(tlv_t) > block_end || tlv_ptr + get_tlv_len((tlv_t*)tlv_ptr) > block_end) return 0;
+        // index entries by type, unknown types are skipped and a type appears at most once.
+        uint8_t tt = ((tlv_t*)tlv_ptr)->tlv_type;
+        if (tt < TLV_TYPE_NUM) {
+            if (view_ptr->tlv_by_type[tt] != NULL) return 0;
+            view_ptr->tlv_by_type[tt] = (tlv_t*) tlv_ptr;
+        }
+        tlv_ptr += get_tlv_len((tlv_t*)tlv_ptr);
+    }
+    // entries must fill the whole block
+    if (tlv_ptr != block_end) return 0;
+    return block_end - buf;
+}
+
+// check a compressed addr block in the raw buffer and fill the view with its runs.
+// return the num of bytes of the block, or 0 if the block does not fit in [buf, buf_end).
+static uint16_t parse_addr_block_view (uint8_t* buf, uint8_t* buf_end, addr_block_view_t* view_ptr) {
+    uint8_t* tmp_ptr = buf;
+    if (tmp_ptr + sizeof(addr_block_t) > buf_end) return 0;
+    view_ptr->addr_num = ((addr_block_t*)tmp_ptr)->addr_num;
+    view_ptr->run_num = 0;
+    tmp_ptr += sizeof(addr_block_t);
+    uint8_t addr_idx = 0;
+    while (addr_idx < view_ptr->addr_num) {
+        if (view_ptr->run_num >= RFC5444_MAX_ADDR_RUN || tmp_ptr + 2 > buf_end) return 0;
+        addr_run_view_t* run_ptr = &view_ptr->run_list[view_ptr->run_num++];
+        uint8_t run_addr_num = tmp_ptr[0];
+        uint8_t flags = tmp_ptr[1];
+        tmp_ptr += 2;
+        memset(run_ptr, 0, sizeof(addr_run_view_t));
+        run_ptr->start_idx = addr_idx;
+        if (run_addr_num == 0 || addr_idx + run_addr_num > view_ptr->addr_num) return 0;
+        if (flags & ADDR_FLAG_HAS_HEAD) {
+            if (tmp_ptr + 1 > buf_end) return 0;
+            run_ptr->head_len = *tmp_ptr++;
+            run_ptr->head_ptr = tmp_ptr;
+            tmp_ptr += run_ptr->head_len;
+        }
+        if (flags & (ADDR_FLAG_HAS_FULL_TAIL | ADDR_FLAG_HAS_ZERO_TAIL)) {
+            if (tmp_ptr + 1 > buf_end) return 0;
+            run_ptr->tail_len = *tmp_ptr++;
+            run_ptr->zero_tail = (flags & ADDR_FLAG_HAS_FULL_TAIL) ? 0 : 1;
+        }
+        if (flags & ADDR_FLAG_HAS_FULL_TAIL) {
+            run_ptr->tail_ptr = tmp_ptr;
+            tmp_ptr += run_ptr->tail_len;
+        }
+        // at least one byte of each addr is not compressed.
+        if (run_ptr->head_len + run_ptr->tail_len >= RFC5444_ADDR_LEN) return 0;
+        run_ptr->mid_len = RFC5444_ADDR_LEN - run_ptr->head_len - run_ptr->tail_len;
+        run_ptr->mid_ptr = tmp_ptr;
+        tmp_ptr += run_addr_num * run_ptr->mid_len;
+        if (tmp_ptr > buf_end) return 0;
+        addr_idx += run_addr_num;
+    }
+    return tmp_ptr - buf;
+}
+
+// decode the msg header in the raw buffer, the fields not on the wire get their default values.
+// return the len of the header on the wire, or 0 if it does not fit in [buf, buf_end).
+static uint8_t parse_msg_header (uint8_t* buf, uint8_t* buf_end, msg_header_t* header_ptr) {
+    if (buf + MSG_HEADER_MIN_LEN > buf_end) return 0;
+    memset(header_ptr, 0, sizeof(msg_header_t));
+    header_ptr->msg_type = buf[0];
+    header_ptr->msg_flags = buf[1] >> 4;
+    header_ptr->msg_addr_len = buf[1] & 0x0f;
+    uint8_t header_len = cal_msg_header_len(header_ptr->msg_flags);
+    uint16_t wire_size = get_u16(buf + 2);
+    if (buf + header_len > buf_end || wire_size < header_len) return 0;
+    header_ptr->msg_size = wire_size - header_len;
+    header_ptr->msg_hop_limit = 1;
+    buf += MSG_HEADER_MIN_LEN;
+    if (header_ptr->msg_flags & MSG_FLAG_HAS_ORIG) {
+        memcpy(header_ptr->msg_orig_addr, buf, RFC5444_ADDR_LEN);
+        buf += RFC5444_ADDR_LEN;
+    }
+    if (header_ptr->msg_flags & MSG_FLAG_HAS_HOP_LIMIT) header_ptr->msg_hop_limit = *buf++;
+    if (header_ptr->msg_flags & MSG_FLAG_HAS_HOP_COUNT) header_ptr->msg_hop_count = *buf++;
+    if (header_ptr->msg_flags & MSG_FLAG_HAS_SEQ_NUM) header_ptr->msg_seq_num = get_u16(buf);
+    return header_len;
+}
+
+// check a HELLO or TC msg in the raw buffer and fill the view.
+// return the num of bytes of the msg, or 0 if the msg is malformed.
+static uint16_t parse_msg_view (uint8_t* msg_data, uint8_t* pkt_end, msg_view_t* view_ptr) {
+    uint16_t tmp_len = 0;
+    // 1. decode the header, the only copy we do.
+    uint8_t header_len = parse_msg_header(msg_data, pkt_end, &view_ptr->header);
+    if (header_len == 0) return 0;
+    // HELLO and TC must have the originator and seq num.
+    if ((view_ptr->header.msg_flags & (MSG_FLAG_HAS_ORIG | MSG_FLAG_HAS_SEQ_NUM)) != (MSG_FLAG_HAS_ORIG | MSG_FLAG_HAS_SEQ_NUM)) return 0;
+    uint8_t* msg_end = msg_data + header_len + view_ptr->header.msg_size;
+    if (msg_end > pkt_end) return 0;
+    view_ptr->msg_data = msg_data;
+    view_ptr->msg_len = msg_end - msg_data;
+    uint8_t* block_ptr = msg_data + header_len;
+    // 2. point to all the blocks
+    // (1) msg_tlv block
+    tmp_len = parse_tlv_block_view(block_ptr, msg_end, &view_ptr->msg_tlv_block);
+    if (tmp_len == 0) return 0;
+    block_ptr += tmp_len;
+    // (2) addr block
+    tmp_len = parse_addr_block_view(block_ptr, msg_end, &view_ptr->addr_block);
+    if (tmp_len == 0) return 0;
+    block_ptr += tmp_len;
+    // (3) addr tlv block
+    tmp_len = parse_tlv_block_view(block_ptr, msg_end, &view_ptr->addr_tlv_block);
+    if (tmp_len == 0) return 0;
+    block_ptr += tmp_len;
+    // 3. check offset
+    if (block_ptr != msg_end) return 0;
+    return view_ptr->msg_len;
+}
+
+// parse the raw packet in place. Nothing is copied except msg headers.
+// every msg is checked, the views of HELLO and TC msgs are drawn from the arena and kept in the msg list,
+// use get_msg_view() to get them one by one. a msg is skipped if there is no room for its view.
+// the views point into raw_packet.pkt_data, so they must not be used after the buffer is reused.
+// return 1 if the packet is well formed, else 0.
+uint8_t parse_raw_packet (raw_pkt_t raw_packet, rfc5444_pkt_view_t* pkt_view_ptr, arena_t* arena_ptr) {
+    assert(pkt_view_ptr != NULL);
+    memset(pkt_view_ptr, 0, sizeof(rfc5444_pkt_view_t));
+    if (raw_packet.pkt_data == NULL || raw_packet.pkt_len < RFC5444_PKT_HEADER_LEN) {
+        ESP_LOGW(TAG, "Raw packet too short!");
+        return 0;
+    }
     uint8_t* raw_pkt_ptr = raw_packet.pkt_data;
-    uint16_t pkt_offset = 0;
-    ret_pkt.version = raw_pkt_ptr[0];
-    ret_pkt.pkt_flags = raw_pkt_ptr[1];
-    ret_pkt.pkt_len = *((uint16_t*)(raw_pkt_ptr + 2));
-    ESP_LOGI(TAG, "Got pkt_len = %d", ret_pkt.pkt_len);
+    uint32_t pkt_offset = 0; // wide enough to skip a bad msg_size
+    pkt_view_ptr->version = raw_pkt_ptr[0];
+    pkt_view_ptr->pkt_flags = raw_pkt_ptr[1];
+    pkt_view_ptr->pkt_len = get_u16(raw_pkt_ptr + 2);
+    ESP_LOGI(TAG, "Got pkt_len = %d", pkt_view_ptr->pkt_len);
     pkt_offset += RFC5444_PKT_HEADER_LEN;
 
     // if it is unknown packet. return.
-    if (ret_pkt.version != 0) {
+    if (pkt_view_ptr->version != 0 || pkt_view_ptr->pkt_len > raw_packet.pkt_len) {
         ESP_LOGW(TAG, "Unknown raw packet type!");
-        ret_pkt.version = 0;
-        ret_pkt.pkt_flags = 0;
-        return ret_pkt;
+        return 0;
     }
+    pkt_view_ptr->pkt_data = raw_pkt_ptr;
 
-    // loop to parse all msg in one packet.
-    while(pkt_offset < ret_pkt.pkt_len) {
+    uint8_t* pkt_end = raw_pkt_ptr + pkt_view_ptr->pkt_len;
+    msg_view_t tmp_view; // only used to check a msg which is skipped
+    msg_view_t* view_ptr = NULL;
+    uint32_t tmp_len = 0;
+    // loop to check all msg in one packet.
+    while(pkt_offset < pkt_view_ptr->pkt_len) {
         // get msg_type
         switch ((msg_type_t)raw_pkt_ptr[pkt_offset]) {
-            case MSG_TYPE_HELLO: {
-                // parse HELLO msg
-                ret_pkt.hello_msg_ptr = malloc(sizeof(hello_msg_t));
-                if(ret_pkt.hello_msg_ptr == NULL) {
-                    ESP_LOGE(TAG, "No mem for hello msg!");
-                    return ret_pkt;
-                }
-                memset(ret_pkt.hello_msg_ptr, 0, sizeof(hello_msg_t));
-                // copy to hello msg and move offset.
-                pkt_offset += copy_to_hello_msg(raw_pkt_ptr + pkt_offset, ret_pkt.hello_msg_ptr);
-                break;
-            }
+            case MSG_TYPE_HELLO:
             case MSG_TYPE_TC: {
-                // parse TC msg
-                ret_pkt.tc_msg_ptr = malloc(sizeof(tc_msg_t));
-                if(ret_pkt.tc_msg_ptr == NULL) {
-                    ESP_LOGE(TAG, "No mem for TC msg!");
-                    return ret_pkt;
+                view_ptr = NULL;
+                if (pkt_view_ptr->msg_num < RFC5444_MAX_MSG_NUM) {
+                    view_ptr = arena_alloc(arena_ptr, sizeof(msg_view_t));
+                }
+                tmp_len = parse_msg_view(raw_pkt_ptr + pkt_offset, pkt_end, (view_ptr != NULL) ? view_ptr : &tmp_view);
+                if (tmp_len == 0) {
+                    ESP_LOGW(TAG, "Malformed msg, drop the packet!");
+                    pkt_view_ptr->msg_num = 0;
+                    return 0;
+                }
+                if (view_ptr != NULL) {
+                    pkt_view_ptr->msg_view_list[pkt_view_ptr->msg_num++] = view_ptr;
+                } else {
+                    ESP_LOGW(TAG, "Too many msgs in one packet, skip one.");
                 }
-                memset(ret_pkt.tc_msg_ptr, 0, sizeof(tc_msg_t));
-                // copy to hello msg and move offset.
-                pkt_offset += copy_to_tc_msg(raw_pkt_ptr + pkt_offset, ret_pkt.tc_msg_ptr);
                 break;
             }
             default: {
+                // skip unknown msg by its size
                 ESP_LOGW(TAG, "Unknown msg type = %d !", raw_pkt_ptr[pkt_offset]);
+                // msg-size on the wire includes the header.
+                if (pkt_offset + MSG_HEADER_MIN_LEN > pkt_view_ptr->pkt_len) {
+                    pkt_view_ptr->msg_num = 0;
+                    return 0;
+                }
+                tmp_len = get_u16(raw_pkt_ptr + pkt_offset + 2);
+                if (tmp_len < MSG_HEADER_MIN_LEN) {
+                    pkt_view_ptr->msg_num = 0;
+                    return 0;
+                }
                 break;
             }
         }
+        pkt_offset += tmp_len;
     }
-    assert(pkt_offset == ret_pkt.pkt_len);
-    return ret_pkt; // user of this pkt must free it.
-}
-
-// rfc5444_pkt should come form info base.
-// this function will not consume rfc5444 pkt. remember free it!
-// the caller must check the raw_pkt.pkt_data field is not NULL!
-raw_pkt_t gen_raw_packet (rfc5444_pkt_t rfc5444_pkt) {
-    raw_pkt_t ret_pkt;
-    uint16_t pkt_offset = 0;
-
-    ret_pkt.pkt_len = rfc5444_pkt.pkt_len;
-    // Send_to event handling in main event loop will free this mem. 
-    ret_pkt.pkt_data = malloc(rfc5444_pkt.pkt_len);
-    if (ret_pkt.pkt_data == NULL) {
-        ESP_LOGE(TAG, "No mem for new paket!");
-        return ret_pkt; // return a NULL packet.
-    }
-    memset(ret_pkt.pkt_data, 0, rfc5444_pkt.pkt_len);
-    // assign the pkt header
-    memcpy(ret_pkt.pkt_data, (uint8_t*)(&rfc5444_pkt), 4);
-    pkt_offset += 4;
-    // assign possible hello msg
-    if (rfc5444_pkt.hello_msg_ptr != NULL) {
-        // copy header
-        memcpy(ret_pkt.pkt_data + pkt_offset, (uint8_t*)(rfc5444_pkt.hello_msg_ptr), sizeof(msg_header_t));
-        pkt_offset += sizeof(msg_header_t);
-        // double check msg type
-        assert(rfc5444_pkt.hello_msg_ptr->header.msg_type == MSG_TYPE_HELLO);
-        // copy blocks
-        // 1. copy msg_tlv_block
-        pkt_offset += \
-            copy_from_tlv_block(ret_pkt.pkt_data + pkt_offset, rfc5444_pkt.hello_msg_ptr->msg_tlv_block_ptr);
-        // 2. copy addr_block
-        pkt_offset += \
-            copy_from_addr_block(ret_pkt.pkt_data + pkt_offset, rfc5444_pkt.hello_msg_ptr->addr_block_ptr);
-        // 3. copy addr_tlv_block
-        pkt_offset += \
-            copy_from_tlv_block(ret_pkt.pkt_data + pkt_offset, rfc5444_pkt.hello_msg_ptr->addr_tlv_block_ptr);        
-    }
-    // assign possible tc msg
-    if (rfc5444_pkt.tc_msg_ptr != NULL) {
-        // copy header
-        memcpy(ret_pkt.pkt_data + pkt_offset, (uint8_t*)(rfc5444_pkt.tc_msg_ptr), sizeof(msg_header_t));
-        pkt_offset += sizeof(msg_header_t);
-        // double check msg type
-        assert(rfc5444_pkt.tc_msg_ptr->header.msg_type == MSG_TYPE_TC);
-        // copy blocks
-        // 1. copy msg_tlv_block
-        pkt_offset += \
-            copy_from_tlv_block(ret_pkt.pkt_data + pkt_offset, rfc5444_pkt.tc_msg_ptr->msg_tlv_block_ptr);
-        // 2. copy addr_block
-        pkt_offset += \
-            copy_from_addr_block(ret_pkt.pkt_data + pkt_offset, rfc5444_pkt.tc_msg_ptr->addr_block_ptr);
-        // 3. copy addr_tlv_block
-        pkt_offset += \
-            copy_from_tlv_block(ret_pkt.pkt_data + pkt_offset, rfc5444_pkt.tc_msg_ptr->addr_tlv_block_ptr);        
+    if (pkt_offset != pkt_view_ptr->pkt_len) {
+        pkt_view_ptr->msg_num = 0;
+        return 0;
     }
-
-    // check pkt offset to make sure pkt len is correct.
-    ESP_LOGI(TAG, "offset = %d, len = %d", pkt_offset, ret_pkt.pkt_len);
-    assert(pkt_offset == ret_pkt.pkt_len);
-
-    return ret_pkt;
+    return 1;
 }
 
+// the view of the idx-th msg of a packet checked by parse_raw_packet(), NULL if there is no such msg.
+msg_view_t* get_msg_view (rfc5444_pkt_view_t* pkt_view_ptr, uint8_t idx) {
+    if (idx >= pkt_view_ptr->msg_num) return NULL;
+    return pkt_view_ptr->msg_view_list[idx];
+}
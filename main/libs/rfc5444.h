@@ -10,21 +10,34 @@
 #include <assert.h>
 #include <string.h>
 #include "esp_log.h"
+#include "arena.h"
 
 #define RFC5444_MAX_PKT_SIZE 1500
-#define RFC5444_MAX_MSG_NUM     3 // max num of msg in one packet
+#define RFC5444_MAX_MSG_NUM     16 // max num of msg in one packet
+#define RFC5444_MAX_ADDR_RUN    8 // max num of compressed runs in one addr block
+#define ADDR_RUN_MIN_HEAD       3 // sorted addrs that do not share an OUI start a new run
 #define RFC5444_ADDR_LEN        6 // we only consider mac address
+#define RFC5444_MAX_TLV_VALUE_LEN   255 // the value len of a tlv is one byte on the wire
+#define RFC5444_MAX_ADDR_VALUE_LEN  3   // max bytes per addr of an addr tlv, COMP_LINK_METRIC
+#define RFC5444_MAX_ADDR_NUM    (RFC5444_MAX_TLV_VALUE_LEN / RFC5444_MAX_ADDR_VALUE_LEN) // max num of addrs in one msg, so that the addr tlvs fit
 
 // hard code some fields since we do need them and will not parse them.
 #define PKT_VERSION             0
 #define PKT_FLAGS               0x0 // no pkt_seq_num, no pkt_tlv
-#define MSG_FLAGS_HELLO         15   // indicating that the message header contains originator address, hop limit, hop count, and message sequence number fields.
-#define MSG_FLAGS_TC            15   
 #define MSG_ADDR_LEN            (RFC5444_ADDR_LEN - 1)
 
+// the 4-bit msg flags, each one indicates an optional field in the msg header.
+#define MSG_FLAG_HAS_ORIG       0x8
+#define MSG_FLAG_HAS_HOP_LIMIT  0x4
+#define MSG_FLAG_HAS_HOP_COUNT  0x2
+#define MSG_FLAG_HAS_SEQ_NUM    0x1
+#define MSG_FLAGS_HELLO         (MSG_FLAG_HAS_ORIG | MSG_FLAG_HAS_SEQ_NUM)  // HELLO is never forwarded, hop limit is 1.
+#define MSG_FLAGS_TC            15   // originator address, hop limit, hop count, and message sequence number fields.
+#define MSG_HEADER_MIN_LEN      4    // type, flags and addr len, size
+
 // the packet bytes to be sent to or received from.
 typedef struct raw_pkt_t {
-    uint8_t mac_addr[RFC5444_ADDR_LEN]; // recv mac addr, not valid when sending
+    uint8_t mac_addr[RFC5444_ADDR_LEN]; // recv mac addr, or dest mac addr when sending
     uint16_t pkt_len;
     uint8_t *pkt_data;
 } raw_pkt_t;
@@ -34,34 +47,77 @@ typedef enum {
     MSG_TYPE_TC,
 } msg_type_t;
 
+// the decoded msg header. On the wire it is
+//      <msg-type:8><msg-flags:4><msg-addr-length:4><msg-size:16>
+//      [<msg-orig-addr>][<msg-hop-limit:8>][<msg-hop-count:8>][<msg-seq-num:16>]
+// with fields in network byte order, see gen_msg_header().
 typedef struct msg_header_t {
     uint8_t msg_type;   // an 8-bit unsigned integer field, specifying the type of the message.
     uint8_t msg_flags;  // a 4-bit field, specifying the interpretation of the remainder of the Message Header
     uint8_t msg_addr_len; // a 4-bit unsigned integer field, encoding the length of all addresses included in this message
                           //  the length of an address in octets - 1, very strange ...
-    uint16_t msg_size;    // a 16-bit unsigned integer field, specifying the number of octets that make up the <message> excluding the header.
+    uint16_t msg_size;    // the number of octets that make up the <message> excluding the header.
+                          // Notice: msg-size on the wire includes the header, as in rfc5444.
     uint8_t msg_orig_addr[RFC5444_ADDR_LEN]; // msg originator address
-    uint8_t msg_hop_limit;
-    uint8_t msg_hop_count;
-    uint32_t msg_seq_num; // is a 16-bit unsigned integer field that can contain a sequence number, 
+    uint8_t msg_hop_limit; // 1 if not on the wire
+    uint8_t msg_hop_count; // 0 if not on the wire
+    uint16_t msg_seq_num; // is a 16-bit unsigned integer field that can contain a sequence number, 
                           // generated by the message’s originator MANET router.
 
 } msg_header_t;
 
-// Summarize all kinds of tlv here.
+// Summarize all kinds of tlv here, as X(type, msg_value_len, addr_value_len, single_value).
+// A msg tlv has a value of msg_value_len bytes, an addr tlv has addr_value_len bytes per addr
+// of the addr block. If single_value is 1, the addr tlv may carry only one value for all addrs,
+// like the single-value tlvs in rfc5444. The tlv enum and the length tables are generated from this list.
+#define TLV_TYPE_TABLE(X) \
+    X(VALIDITY_TIME,    1, 0, 0) \
+    X(INTERVAL_TIME,    1, 0, 0) \
+    X(CONT_SEQ_NUM,     2, 0, 0) \
+    X(MPR_WILLING,      1, 0, 0) \
+    X(LINK_STATUS,      0, 1, 0) /* three addr tlv entries */ \
+    X(LINK_METRIC,      0, 2, 0) /* out going metric list, then in comming metric list */ \
+    X(MPR_STATUS,       0, 2, 0) /* flooding status list, then routing status list */ \
+    X(HELLO_BASE_SEQ,   2, 0, 0) /* msg seq num of the full HELLO a delta HELLO is based on */ \
+    X(LINK_MPR_STATUS,  0, 1, 0) /* link status, flooding and routing MPR status packed in one byte */ \
+    X(COMP_LINK_METRIC, 0, 3, 1) /* 12-bit compressed out and in metrics, see gen_metric_pair() */ \
+    X(PART_ADDR_RANGE,  12, 0, 0) /* a msg part covers the addrs in [first addr, second addr), see get_part_range() */
+
+#define TLV_TYPE_ENUM(type, msg_len, addr_len, single)  type,
 typedef enum tlv_type_t {
-    VALIDITY_TIME,
-    INTERVAL_TIME,
-    CONT_SEQ_NUM,
-    MPR_WILLING,
-    LINK_STATUS, // three addr tlv entries
-    LINK_METRIC, // this should be in comming link metric
-    MPR_STATUS,
+    TLV_TYPE_TABLE(TLV_TYPE_ENUM)
+    TLV_TYPE_NUM,
 } tlv_type_t;
 
-// TODO
+/* A schema lists the tlvs of one tlv block in wire order.
+ * A msg tlv block schema is X(type, value), value is the expr written by TLV_SCHEMA_GEN_VALUE.
+ * An addr tlv block schema is X(type), the per addr values are written by the msg generator.
+ * DEFINE_*_TLV_SCHEMA() turns a schema into a tlv_schema_t, which gives the block len, the
+ * block header and the receive check, so the encoder and the decoder can not disagree on the layout.
+ */
+typedef struct tlv_schema_t {
+    uint8_t is_addr;    // 1 for an addr tlv block, the values are per addr.
+    uint8_t tlv_num;
+    const tlv_type_t* type_list;
+} tlv_schema_t;
+
+#define TLV_SCHEMA_TYPE(type, ...)      type,
+#define TLV_SCHEMA_COUNT(type, ...)     + 1
+#define TLV_SCHEMA_NUM(schema)          (0 schema(TLV_SCHEMA_COUNT))
+#define DEFINE_TLV_SCHEMA(name, schema, is_addr) \
+    static const tlv_type_t name##_type_list[] = { schema(TLV_SCHEMA_TYPE) }; \
+    static const tlv_schema_t name = { is_addr, TLV_SCHEMA_NUM(schema), name##_type_list };
+#define DEFINE_MSG_TLV_SCHEMA(name, schema)     DEFINE_TLV_SCHEMA(name, schema, 0)
+#define DEFINE_ADDR_TLV_SCHEMA(name, schema)    DEFINE_TLV_SCHEMA(name, schema, 1)
+// write one msg tlv of a msg tlv block schema, needs a writer_ptr in scope.
+#define TLV_SCHEMA_GEN_VALUE(type, value)   gen_tlv_uint(writer_ptr, type, value);
+
+// addr flags of a compressed run, as in rfc5444
 enum addr_flag {
-    NORMAL_ADDR,
+    NORMAL_ADDR = 0,
+    ADDR_FLAG_HAS_HEAD = 0x80,
+    ADDR_FLAG_HAS_FULL_TAIL = 0x40,
+    ADDR_FLAG_HAS_ZERO_TAIL = 0x20,
 };
 
 typedef struct tlv_t {
@@ -70,63 +126,127 @@ typedef struct tlv_t {
     uint8_t tlv_value[0]; // not a pointer finally. just free this tlv!
 } __attribute__((packed)) tlv_t;
 
+// the header of a tlv block on the wire, tlv entries follow it directly.
 typedef struct tlv_block_t
 {
     uint8_t tlv_block_type;
-    uint8_t tlv_ptr_len; // length of the tlv_ptr_list
-    uint16_t tlv_block_size; // size of rest of the block.
-    tlv_t*   tlv_ptr_list[0]; // Note: this is a list of pointer.
+    uint8_t tlv_ptr_len; // num of tlv entries in this block
+    uint16_t tlv_block_size; // size of rest of the block, in network byte order.
 } __attribute__((packed)) tlv_block_t;
 
+// addrs are compressed with rfc5444 head/tail compression. To make use of the shared OUI of
+// each vendor, the block is a list of runs, each run has its own head and tail:
+//      <run-addr-num:8><addr-flags:8>[head-len:8][head][tail-len:8][tail]<mid>*
+// runs are on the wire until addr_num addrs are covered.
 typedef struct addr_block_t
 {
-    uint16_t addr_num;
-    uint8_t addr_list[0];       // Notice: each addr has RFC5444_ADDR_LEN bytes.
+    uint8_t addr_num;           // total num of addrs in this block
+    uint8_t run_data[0];
 } __attribute__((packed)) addr_block_t;
 
 
-// msg must be created by alloc.
-typedef struct hello_msg_t {
-    msg_header_t header;
-    // this struct will only hold pointers to blocks
-    tlv_block_t* msg_tlv_block_ptr;
-    addr_block_t* addr_block_ptr;
-    tlv_block_t* addr_tlv_block_ptr;
-} hello_msg_t;
-
-typedef struct tc_msg_t {
-    msg_header_t header;
-    tlv_block_t* msg_tlv_block_ptr;
-    addr_block_t* addr_block_ptr;
-    tlv_block_t* addr_tlv_block_ptr;  
-} tc_msg_t;
-
-// union of all kinds of msg ptr
-// typedef union rfc5444_msg_t {
-//     hello_msg_t* hello_msg_ptr;
-//     tc_msg_t* tc_msg_ptr;
-// } rfc5444_msg_ptr;
-
+// packet header on the wire
+// just use a byte to hold 4-bit field to keep things simple ...
+//      uint8_t version;    // 4-bit unsigned integer field, version 0
+//      uint8_t pkt_flags;  // 4-bit field, bit 0 (pkt has seq_num), bit 1 (pkt has tlv).
+//      uint16_t pkt_len;   // length of the whole packet, not in rfc5444, added for convenience.
 #define RFC5444_PKT_HEADER_LEN 4
-typedef struct rfc5444_pkt_t {
-    // packet header
-    // just use a byte to hold 4-bit field to keep things simple ...
-    uint8_t version;    // 4-bit unsigned integer field, version 0
-    uint8_t pkt_flags;  // 4-bit field, bit 0 (pkt has seq_num), bit 1 (pkt has tlv).
-    uint16_t pkt_len;   // length of the whole packet, not in rfc5444, added for convenience.
-    // rfc5444_msg_ptr msg_list[RFC5444_MAX_MSG_NUM]; // list of ptr to the msg
-    hello_msg_t* hello_msg_ptr;
-    tc_msg_t* tc_msg_ptr;
-} rfc5444_pkt_t;
+
+/* A cursor to write packet bytes into a caller provided buffer.
+ * For a flat buffer, seg_payload_len is 0 and bytes are written contiguously.
+ * For a framed buffer, the buffer is a list of frames of (seg_head_len + seg_payload_len) bytes.
+ * Each frame keeps seg_head_len bytes free for the frame header, followed by the next
+ * seg_payload_len bytes of the packet, so frames can be sent without another copy.
+ */
+typedef struct pkt_writer_t {
+    uint8_t* buf;
+    uint16_t offset;            // logical offset in the packet, frame headers not counted.
+    uint16_t seg_head_len;
+    uint16_t seg_payload_len;
+} pkt_writer_t;
+
+/* Read-only views of a received packet.
+ * All pointers point into the raw packet buffer, so parsing does not alloc any mem.
+ * A view is only valid while the raw packet buffer is alive (one recv event).
+ */
+typedef struct tlv_block_view_t {
+    uint8_t tlv_num;
+    uint16_t tlv_block_size;
+    tlv_t* tlv_by_type[TLV_TYPE_NUM]; // the tlv entry of each type in the raw buffer, NULL if absent
+} tlv_block_view_t;
+
+typedef struct addr_run_view_t {
+    uint8_t start_idx;              // index of the first addr of this run in the block
+    uint8_t head_len;
+    uint8_t tail_len;               // tail bytes are zero and not on the wire if zero_tail is set
+    uint8_t zero_tail;
+    uint8_t mid_len;
+    uint8_t* head_ptr;
+    uint8_t* tail_ptr;
+    uint8_t* mid_ptr;               // addr_num mid parts of mid_len bytes each
+} addr_run_view_t;
+
+typedef struct addr_block_view_t {
+    uint8_t addr_num;
+    uint8_t run_num;
+    addr_run_view_t run_list[RFC5444_MAX_ADDR_RUN];
+} addr_block_view_t;
+
+typedef struct msg_view_t {
+    msg_header_t header;            // a decoded copy, the header on the wire may be unaligned.
+    uint8_t* msg_data;              // start of this msg (header included) in the raw buffer
+    uint16_t msg_len;               // header + msg_size
+    tlv_block_view_t msg_tlv_block;
+    addr_block_view_t addr_block;
+    tlv_block_view_t addr_tlv_block;
+} msg_view_t;
+
+typedef struct rfc5444_pkt_view_t {
+    uint8_t version;
+    uint8_t pkt_flags;
+    uint16_t pkt_len;
+    uint8_t* pkt_data;              // the raw packet
+    uint8_t msg_num;                // num of HELLO and TC msgs
+    msg_view_t* msg_view_list[RFC5444_MAX_MSG_NUM]; // the view of each msg, from the first pass, in the arena
+} rfc5444_pkt_view_t;
 
 
 /* exported functions */
 uint8_t cal_tlv_len(tlv_type_t);
-uint8_t get_tlv_value (tlv_block_t* tlv_block_ptr, tlv_type_t tt, uint8_t** buf_pp);
-uint16_t get_tlv_block_len (tlv_block_t* tlv_block);
-uint16_t get_addr_block_len (addr_block_t* addr_block_ptr);
-void free_rfc5444_pkt(rfc5444_pkt_t);
-rfc5444_pkt_t parse_raw_packet (raw_pkt_t raw_packet);
-raw_pkt_t gen_raw_packet (rfc5444_pkt_t rfc5444_pkt);
+uint16_t cal_addr_tlv_len (tlv_type_t type, uint8_t addr_num);
+uint16_t cal_tlv_block_len (const tlv_schema_t* schema_ptr, uint8_t addr_num);
+uint8_t check_tlv_block (tlv_block_view_t* tlv_block_ptr, const tlv_schema_t* schema_ptr, uint8_t addr_num);
+uint8_t get_tlv_value (tlv_block_view_t* tlv_block_ptr, tlv_type_t tt, uint8_t** buf_pp);
+uint8_t* get_addr_tlv_value (tlv_block_view_t* tlv_block_ptr, tlv_type_t tt, uint8_t idx);
+uint16_t get_tlv_uint (tlv_block_view_t* tlv_block_ptr, tlv_type_t tt);
+void get_addr (addr_block_view_t* addr_block_ptr, uint8_t idx, uint8_t addr[RFC5444_ADDR_LEN]);
+uint16_t cal_addr_block_len (uint8_t addr_table[][RFC5444_ADDR_LEN], uint8_t* id_list, uint8_t addr_num);
+void gen_addr_block (pkt_writer_t* writer_ptr, uint8_t addr_table[][RFC5444_ADDR_LEN], uint8_t* id_list, uint8_t addr_num);
+uint8_t parse_raw_packet (raw_pkt_t raw_packet, rfc5444_pkt_view_t* pkt_view_ptr, arena_t* arena_ptr);
+msg_view_t* get_msg_view (rfc5444_pkt_view_t* pkt_view_ptr, uint8_t idx);
+uint16_t get_u16 (const uint8_t* buf);
+uint16_t compress_metric (uint32_t metric);
+uint32_t decompress_metric (uint16_t comp_metric);
+void get_metric_pair (const uint8_t* buf, uint32_t* out_metric_ptr, uint32_t* in_metric_ptr);
+uint8_t cal_msg_header_len (uint8_t msg_flags);
+uint16_t cal_framed_buf_len (uint16_t pkt_len, uint16_t seg_head_len, uint16_t seg_payload_len);
+void pkt_writer_init (pkt_writer_t* writer_ptr, uint8_t* buf, uint16_t seg_head_len, uint16_t seg_payload_len);
+void pkt_write (pkt_writer_t* writer_ptr, const void* src, uint16_t len);
+void pkt_write_u8 (pkt_writer_t* writer_ptr, uint8_t value);
+void pkt_write_u16 (pkt_writer_t* writer_ptr, uint16_t value);
+void gen_pkt_header (pkt_writer_t* writer_ptr, uint16_t pkt_len);
+void gen_msg_header (pkt_writer_t* writer_ptr, msg_header_t* header_ptr);
+void gen_tlv_block_header (pkt_writer_t* writer_ptr, uint8_t tlv_num, uint16_t tlv_block_size);
+void gen_tlv_block_header_by_schema (pkt_writer_t* writer_ptr, const tlv_schema_t* schema_ptr, uint8_t addr_num);
+void gen_tlv (pkt_writer_t* writer_ptr, tlv_type_t tt, uint8_t value_len, const uint8_t* value_ptr);
+void gen_tlv_uint (pkt_writer_t* writer_ptr, tlv_type_t tt, uint16_t value);
+void gen_addr_tlv_header (pkt_writer_t* writer_ptr, tlv_type_t tt, uint8_t addr_num);
+void gen_metric_pair (pkt_writer_t* writer_ptr, uint32_t out_metric, uint32_t in_metric);
+void gen_forward_msg (pkt_writer_t* writer_ptr, msg_view_t* msg_view_ptr);
+uint8_t get_part_range (tlv_block_view_t* tlv_block_ptr, uint8_t** range_pp);
+uint8_t is_addr_in_part (const uint8_t* range_ptr, const uint8_t addr[RFC5444_ADDR_LEN]);
+uint16_t cal_msg_tlv_block_len (const tlv_schema_t* schema_ptr, uint8_t is_part);
+void gen_msg_tlv_block_header (pkt_writer_t* writer_ptr, const tlv_schema_t* schema_ptr, uint8_t is_part);
+void gen_part_range_tlv (pkt_writer_t* writer_ptr, const uint8_t lo_addr[RFC5444_ADDR_LEN], const uint8_t hi_addr[RFC5444_ADDR_LEN]);
 
 #endif
\ No newline at end of file
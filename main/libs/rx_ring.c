@@ -0,0 +1,49 @@
+#include "rx_ring.h"
+
+// head and tail only grow, the slot is the index mod RX_RING_SIZE.
+// the producer publishes a slot by a release store of head after filling it,
+// the consumer frees a slot by a release store of tail after handling it.
+
+// copy a frame into the ring, called by the producer only.
+// return 0 and count the drop if the ring is full or the frame is too long, never blocks.
+uint8_t rx_ring_push (rx_ring_t* ring_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN], const uint8_t* data, int data_len) {
+    uint32_t head = ring_ptr->head;
+    uint32_t tail = __atomic_load_n(&ring_ptr->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= RX_RING_SIZE || data_len > ESPNOW_MAX_DATA_LEN) {
+        ring_ptr->drop_num ++;
+        return 0;
+    }
+    rx_frame_t* frame_ptr = &ring_ptr->slot_list[head & (RX_RING_SIZE - 1)];
+    memcpy(frame_ptr->mac_addr, mac_addr, RFC5444_ADDR_LEN);
+    memcpy(frame_ptr->data, data, data_len);
+    frame_ptr->data_len = data_len;
+    __atomic_store_n(&ring_ptr->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// the oldest frame in the ring, NULL if empty. called by the consumer only.
+// the frame stays valid until rx_ring_pop().
+rx_frame_t* rx_ring_peek (rx_ring_t* ring_ptr) {
+    uint32_t tail = ring_ptr->tail;
+    if (__atomic_load_n(&ring_ptr->head, __ATOMIC_ACQUIRE) == tail) {
+        return NULL;
+    }
+    return &ring_ptr->slot_list[tail & (RX_RING_SIZE - 1)];
+}
+
+// after a push, whether the producer should wake up the consumer.
+// only the first push after the consumer cleared the flag wakes it up, the consumer drains the whole ring.
+// the flag is set after head is published and cleared before the ring is drained, so no frame is missed.
+uint8_t rx_ring_need_wake (rx_ring_t* ring_ptr) {
+    return !__atomic_exchange_n(&ring_ptr->wake_pending, 1, __ATOMIC_SEQ_CST);
+}
+
+// called by the consumer before it drains the ring.
+void rx_ring_clear_wake (rx_ring_t* ring_ptr) {
+    __atomic_store_n(&ring_ptr->wake_pending, 0, __ATOMIC_SEQ_CST);
+}
+
+// give the oldest slot back to the producer. called by the consumer only.
+void rx_ring_pop (rx_ring_t* ring_ptr) {
+    __atomic_store_n(&ring_ptr->tail, ring_ptr->tail + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,33 @@
+/*
+ * a lock-free single-producer/single-consumer ring of received frames.
+ * The WiFi task (recv cb) copies frames into preallocated slots, the OLSR task handles them in place,
+ * so no mem is allocated and nothing blocks in the WiFi task. Frames are dropped if the ring is full.
+ */
+
+#ifndef RX_RING_H
+#define RX_RING_H
+#include "espnow_olsr.h"
+
+#define RX_RING_SIZE    32  // num of frame slots, must be a power of 2
+
+typedef struct rx_frame_t {
+    uint8_t mac_addr[RFC5444_ADDR_LEN];
+    uint8_t data_len;
+    uint8_t data[ESPNOW_MAX_DATA_LEN];
+} rx_frame_t;
+
+typedef struct rx_ring_t {
+    rx_frame_t slot_list[RX_RING_SIZE];
+    uint32_t head;          // next slot to write, only changed by the producer
+    uint32_t tail;          // next slot to read, only changed by the consumer
+    uint32_t drop_num;      // frames dropped since the ring is full, only changed by the producer
+    uint8_t wake_pending;   // set by the producer when it wakes up the consumer, cleared by the consumer
+} rx_ring_t;
+
+uint8_t rx_ring_push (rx_ring_t* ring_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN], const uint8_t* data, int data_len);
+rx_frame_t* rx_ring_peek (rx_ring_t* ring_ptr);
+void rx_ring_pop (rx_ring_t* ring_ptr);
+uint8_t rx_ring_need_wake (rx_ring_t* ring_ptr);
+void rx_ring_clear_wake (rx_ring_t* ring_ptr);
+
+#endif
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include "tx_sched.h"
+
+static const char *TAG = "espnow_tx_sched";
+
+static const uint8_t broadcast_addr[RFC5444_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+void tx_sched_init (tx_sched_t* sched_ptr, void (*set_rate)(uint8_t rate)) {
+    memset(sched_ptr, 0, sizeof(tx_sched_t));
+    sched_ptr->cur_rate = TX_RATE_UNKNOWN;
+    sched_ptr->set_rate = set_rate;
+}
+
+// free all packets waiting.
+void tx_sched_deinit (tx_sched_t* sched_ptr) {
+    while (sched_ptr->pkt_num > 0) {
+        free(sched_ptr->pkt_list[sched_ptr->head].pkt_data);
+        sched_ptr->head = (sched_ptr->head + 1) % TX_QUEUE_SIZE;
+        sched_ptr->pkt_num --;
+    }
+}
+
+// queue a framed packet with its frame headers prepared, to be sent at the rate.
+// the scheduler frees pkt_data once it is sent.
+// return 0 and free pkt_data if the queue is full.
+uint8_t tx_sched_push (tx_sched_t* sched_ptr, raw_pkt_t pkt, uint8_t rate) {
+    if (sched_ptr->pkt_num == TX_QUEUE_SIZE) {
+        ESP_LOGW(TAG, "TX queue full, drop a packet of len %d", pkt.pkt_len);
+        sched_ptr->drop_num ++;
+        free(pkt.pkt_data);
+        return 0;
+    }
+    sched_ptr->pkt_list[(sched_ptr->head + sched_ptr->pkt_num) % TX_QUEUE_SIZE] = pkt;
+    sched_ptr->rate_list[(sched_ptr->head + sched_ptr->pkt_num) % TX_QUEUE_SIZE] = rate;
+    sched_ptr->pkt_num ++;
+    return 1;
+}
+
+// whether a queued packet, the one being sent included, is sent to the addr.
+uint8_t tx_sched_has_dest (tx_sched_t* sched_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN]) {
+    for (int p = 0; p < sched_ptr->pkt_num; p++) {
+        if (memcmp(sched_ptr->pkt_list[(sched_ptr->head + p) % TX_QUEUE_SIZE].mac_addr, mac_addr, RFC5444_ADDR_LEN) == 0) return 1;
+    }
+    return 0;
+}
+
+// called by the WiFi task in the send cb.
+// return whether the OLSR task should be woken up to pump, only the first send cb after a pump does.
+uint8_t tx_sched_send_done (tx_sched_t* sched_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN], esp_now_send_status_t status) {
+    if (status != ESP_NOW_SEND_SUCCESS) {
+        __atomic_add_fetch(&sched_ptr->fail_num, 1, __ATOMIC_RELAXED);
+    }
+    // broadcast frames are not acked, their status tells nothing about the link.
+    if (memcmp(mac_addr, broadcast_addr, RFC5444_ADDR_LEN) != 0) {
+        uint32_t tail = sched_ptr->result_tail;
+        if (tail - __atomic_load_n(&sched_ptr->result_head, __ATOMIC_ACQUIRE) < TX_RESULT_RING_SIZE) {
+            tx_result_t* result_ptr = &sched_ptr->result_list[tail % TX_RESULT_RING_SIZE];
+            memcpy(result_ptr->mac_addr, mac_addr, RFC5444_ADDR_LEN);
+            result_ptr->is_acked = (status == ESP_NOW_SEND_SUCCESS);
+            __atomic_store_n(&sched_ptr->result_tail, tail + 1, __ATOMIC_RELEASE);
+        } else {
+            __atomic_add_fetch(&sched_ptr->result_drop_num, 1, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_add_fetch(&sched_ptr->done_num, 1, __ATOMIC_RELEASE);
+    return !__atomic_exchange_n(&sched_ptr->wake_pending, 1, __ATOMIC_SEQ_CST);
+}
+
+// called by the OLSR task, get the oldest send cb of a unicast frame.
+// return 0 if there is none.
+uint8_t tx_sched_pop_result (tx_sched_t* sched_ptr, tx_result_t* result_ptr) {
+    uint32_t head = sched_ptr->result_head;
+    if (head == __atomic_load_n(&sched_ptr->result_tail, __ATOMIC_ACQUIRE)) return 0;
+    *result_ptr = sched_ptr->result_list[head % TX_RESULT_RING_SIZE];
+    __atomic_store_n(&sched_ptr->result_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// the packet being sent is done or dropped.
+static void pop_pkt (tx_sched_t* sched_ptr) {
+    free(sched_ptr->pkt_list[sched_ptr->head].pkt_data);
+    sched_ptr->head = (sched_ptr->head + 1) % TX_QUEUE_SIZE;
+    sched_ptr->pkt_num --;
+    sched_ptr->frame_idx = 0;
+}
+
+// num of frames sent and not confirmed yet.
+static uint32_t cal_in_flight_num (tx_sched_t* sched_ptr) {
+    uint32_t done_num = __atomic_load_n(&sched_ptr->done_num, __ATOMIC_ACQUIRE);
+    int32_t in_flight_num = (int32_t)(sched_ptr->sent_num - sched_ptr->lost_num - done_num);
+    if (in_flight_num < 0) {
+        // send cbs of frames given up came late after all.
+        sched_ptr->lost_num += in_flight_num;
+        in_flight_num = 0;
+    }
+    return in_flight_num;
+}
+
+// hand frames to the driver until the window is full, the driver has no mem, or no packet is waiting.
+// called by the OLSR task after each event.
+// return ms to wait before calling it again if no send cb comes, TX_WAIT_FOREVER if nothing is waiting.
+uint32_t tx_sched_pump (tx_sched_t* sched_ptr, uint32_t now_ms) {
+    __atomic_store_n(&sched_ptr->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+    while (sched_ptr->pkt_num > 0) {
+        if (sched_ptr->backoff_ms != 0 && (int32_t)(now_ms - sched_ptr->resume_ms) < 0) {
+            return sched_ptr->resume_ms - now_ms;
+        }
+        uint32_t in_flight_num = cal_in_flight_num(sched_ptr);
+        // the rate is switched before the first frame of a packet, frames in flight must not be sent at the new rate.
+        uint8_t rate = sched_ptr->rate_list[sched_ptr->head];
+        uint8_t is_rate_changed = (sched_ptr->frame_idx == 0 && rate != sched_ptr->cur_rate);
+        if (in_flight_num >= TX_WINDOW_SIZE || (is_rate_changed && in_flight_num > 0)) {
+            if ((int32_t)(now_ms - sched_ptr->sent_ms) < TX_SEND_CB_TIMEOUT_MS) {
+                return sched_ptr->sent_ms + TX_SEND_CB_TIMEOUT_MS - now_ms;
+            }
+            ESP_LOGW(TAG, "No send cb for %d frames, give them up.", in_flight_num);
+            sched_ptr->lost_num += in_flight_num;
+        }
+        if (is_rate_changed) {
+            sched_ptr->set_rate(rate);
+            sched_ptr->cur_rate = rate;
+        }
+
+        raw_pkt_t* pkt_ptr = &sched_ptr->pkt_list[sched_ptr->head];
+        uint8_t seg_num = ESPNOW_SEG_NUM(pkt_ptr->pkt_len);
+        espnow_olsr_frame_t* frame_ptr = (espnow_olsr_frame_t*)(pkt_ptr->pkt_data + sched_ptr->frame_idx * ESPNOW_MAX_DATA_LEN);
+        esp_err_t err = esp_now_send(pkt_ptr->mac_addr, (const uint8_t*)frame_ptr, frame_ptr->len);
+
+        if (err == ESP_ERR_ESPNOW_NO_MEM) {
+            // the driver's TX bufs are full, retry the same frame later.
+            sched_ptr->backoff_ms = (sched_ptr->backoff_ms == 0) ? TX_BACKOFF_MIN_MS : sched_ptr->backoff_ms * 2;
+            if (sched_ptr->backoff_ms > TX_BACKOFF_MAX_MS) sched_ptr->backoff_ms = TX_BACKOFF_MAX_MS;
+            sched_ptr->resume_ms = now_ms + sched_ptr->backoff_ms;
+            sched_ptr->retry_num ++;
+            continue;
+        }
+        sched_ptr->backoff_ms = 0;
+        if (err != ESP_OK) {
+            // the rest of the packet is useless, the receivers drop it on timeout.
+            ESP_LOGE(TAG, "ESPNOW Send error %d, drop the packet.", err);
+            sched_ptr->drop_num ++;
+            pop_pkt(sched_ptr);
+            continue;
+        }
+        sched_ptr->sent_num ++;
+        sched_ptr->sent_ms = now_ms;
+        sched_ptr->frame_idx ++;
+        if (sched_ptr->frame_idx == seg_num + ESPNOW_PARITY_NUM(seg_num)) {
+            pop_pkt(sched_ptr);
+        }
+    }
+    return TX_WAIT_FOREVER;
+}
@@ -0,0 +1,63 @@
+/*
+ * the TX scheduler of framed packets.
+ * Packets wait in a FIFO, their frames are handed to the ESPNOW driver in order, but only TX_WINDOW_SIZE frames
+ * can be in flight (sent but not confirmed by the send cb), so a long packet does not overrun the driver's TX bufs.
+ * If the driver has no mem, the frame is retried after an exponential backoff.
+ * The driver sends at one fixed PHY rate, so each packet carries its rate and the rate is switched between
+ * packets once no frame is in flight. The send cbs of unicast frames are kept for the rate control.
+ * The OLSR task owns the scheduler, the WiFi task only reports the send cbs.
+ */
+
+#ifndef TX_SCHED_H
+#define TX_SCHED_H
+#include "espnow_olsr.h"
+
+#define TX_QUEUE_SIZE           16      // max num of packets waiting to be sent, a split msg is a few packets
+#define TX_WINDOW_SIZE          2       // max num of frames in flight
+#define TX_BACKOFF_MIN_MS       4       // the first retry after ESP_ERR_ESPNOW_NO_MEM
+#define TX_BACKOFF_MAX_MS       128
+#define TX_SEND_CB_TIMEOUT_MS   100     // frames in flight are given up if no send cb comes in time
+#define TX_WAIT_FOREVER         UINT32_MAX
+#define TX_RESULT_RING_SIZE     8       // send cbs of unicast frames waiting for the OLSR task, a power of 2
+#define TX_RATE_UNKNOWN         0xff
+
+// the send cb of a unicast frame.
+typedef struct tx_result_t {
+    uint8_t mac_addr[RFC5444_ADDR_LEN];
+    uint8_t is_acked;
+} tx_result_t;
+
+typedef struct tx_sched_t {
+    // framed bufs ready to be sent, see espnow_olsr_event_send_to_t. pkt.mac_addr is the dest addr.
+    raw_pkt_t pkt_list[TX_QUEUE_SIZE];
+    uint8_t rate_list[TX_QUEUE_SIZE];   // the rate of each packet
+    uint8_t head;           // the packet being sent
+    uint8_t pkt_num;
+    uint8_t frame_idx;      // next frame of the packet being sent
+    uint32_t sent_num;      // frames handed to the driver, only changed by the OLSR task
+    uint32_t done_num;      // send cbs, only changed by the WiFi task
+    uint32_t lost_num;      // frames given up without send cb, only changed by the OLSR task
+    uint32_t backoff_ms;    // 0 if the last frame is sent
+    uint32_t resume_ms;     // when the frame can be retried, valid if backoff_ms != 0
+    uint32_t sent_ms;       // when the last frame is sent
+    uint32_t drop_num;      // packets dropped since the queue is full or the driver fails
+    uint32_t retry_num;     // frames retried after ESP_ERR_ESPNOW_NO_MEM
+    uint32_t fail_num;      // send cbs with ESP_NOW_SEND_FAIL, only changed by the WiFi task
+    uint8_t wake_pending;   // set by the WiFi task when it wakes up the OLSR task, cleared by tx_sched_pump()
+    uint8_t cur_rate;       // the rate set in the driver, TX_RATE_UNKNOWN before the first packet
+    void (*set_rate)(uint8_t rate);     // sets the rate in the driver
+    tx_result_t result_list[TX_RESULT_RING_SIZE];
+    uint32_t result_head;   // only changed by the OLSR task
+    uint32_t result_tail;   // only changed by the WiFi task
+    uint32_t result_drop_num;   // send cbs dropped since the ring is full, only changed by the WiFi task
+} tx_sched_t;
+
+void tx_sched_init (tx_sched_t* sched_ptr, void (*set_rate)(uint8_t rate));
+uint8_t tx_sched_push (tx_sched_t* sched_ptr, raw_pkt_t pkt, uint8_t rate);
+uint8_t tx_sched_has_dest (tx_sched_t* sched_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN]);
+uint8_t tx_sched_send_done (tx_sched_t* sched_ptr, const uint8_t mac_addr[RFC5444_ADDR_LEN], esp_now_send_status_t status);
+uint8_t tx_sched_pop_result (tx_sched_t* sched_ptr, tx_result_t* result_ptr);
+uint32_t tx_sched_pump (tx_sched_t* sched_ptr, uint32_t now_ms);
+void tx_sched_deinit (tx_sched_t* sched_ptr);
+
+#endif